@@ -1,91 +1,396 @@
 #include "benchmark.hpp"
 
 #include "parser.hpp"
+#include "util.hpp"
+
+#include <cmath>
+
+/**
+ * \brief Half width of the wilson score interval of a rate.
+ * \param hits Rounds with the outcome
+ * \param rounds Fought rounds
+ * \param z Quantile of the standard normal distribution
+ */
+static double wilson_half_width(uint32_t hits, uint32_t rounds, double z)
+{
+    double n = rounds;
+    double p = hits / n;
+    return z * std::sqrt(p * (1.0 - p) / n + z * z / (4.0 * n * n)) / (1.0 + z * z / n);
+}
 
 void benchmark::add_warrior(const std::shared_ptr<warrior>& w)
 {
     warriors.push_back(w);
 }
 
-void benchmark::add_directory(const std::string& path)
+std::vector<std::string> benchmark::add_directory(const std::string& path)
 {
-    parser p(core_size, max_cycles, max_process, max_length, min_separation);
-
+    // Sorted, so the order of the warriors doesn't depend on the file system
+    std::vector<fs::path> files;
     for (const auto & entry : fs::directory_iterator(path))
     {
-        try
+        files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    // Every task parses a contiguous block of files with its own parser
+    size_t blocks = std::min(files.size(), (size_t)_threads * 4);
+    std::vector<std::shared_ptr<warrior>> parsed(files.size());
+    std::vector<std::string> errors(files.size());
+    auto parse_block = [&](size_t block)
+    {
+        parser p(core_size, max_cycles, max_process, max_length, min_separation);
+        for (size_t i = files.size() * block / blocks; i < files.size() * (block + 1) / blocks; ++i)
         {
-            std::fstream f(entry.path());
-            if (!f || f.bad() || !f.is_open()) continue;
+            try
+            {
+                std::fstream f(files[i]);
+                if (!f || f.bad() || !f.is_open()) continue;
+
+                parsed[i] = p.parse(f);
+            }
+            catch (std::exception& ex)
+            {
+                errors[i] = "(" + files[i].string() + ") " + ex.what();
+            }
+        }
+    };
+
+    if (_pool != nullptr) _pool->parallel_for(blocks, parse_block);
+    else for (size_t i = 0; i < blocks; ++i) parse_block(i);
+
+    std::vector<std::string> failed;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (parsed[i] != nullptr && parsed[i]->code.size() <= max_length)
+            warriors.push_back(parsed[i]);
+
+        if (!errors[i].empty())
+            failed.push_back(errors[i]);
+    }
+
+    return failed;
+}
+
+uint64_t benchmark::settings_hash() const
+{
+    uint64_t h = util::hash_offset;
+    for (uint64_t setting : { core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, rounds_per_enemy, seed })
+    {
+        h = util::hash(h, setting);
+    }
+
+    return util::hash(h, pairing_seeds);
+}
+
+uint32_t benchmark::pairing_seed(const warrior& target, const warrior& enemy) const
+{
+    if (!pairing_seeds) return seed;
+
+    // The generator would stay at 0 forever, so the seeds are kept inside [1, 2^31 - 1)
+    uint64_t h = util::hash(util::hash(util::hash(util::hash_offset, seed), target.hash()), enemy.hash());
+    return (uint32_t)(1 + h % 2147483646);
+}
+
+uint32_t benchmark::chunks_per_pairing(uint32_t rounds, size_t pairings) const
+{
+    uint32_t chunks = 1;
+    if (rounds_per_chunk > 0) chunks = (rounds + rounds_per_chunk - 1) / rounds_per_chunk;
+    else if (_pool != nullptr && pairings > 0) chunks = (uint32_t)((4 * (size_t)_threads + pairings - 1) / pairings);
+
+    return std::max(1u, std::min(chunks, rounds));
+}
+
+template <typename F>
+void benchmark::run_chunks(size_t count, result* results, F&& chunk)
+{
+    if (_pool != nullptr) _pool->map(count, results, chunk);
+    else for (size_t i = 0; i < count; ++i) results[i] = chunk(i);
+}
 
-            auto parsed = p.parse(f);
-            if (parsed != nullptr && parsed->code.size() <= max_length)
-                warriors.push_back(parsed);
+std::any benchmark::run(const std::shared_ptr<warrior>& target)
+{
+    return run_many({ target })[0].score;
+}
 
-            f.close();
+std::vector<result> benchmark::run_pairings(const std::vector<pairing>& pairings)
+{
+    // Only the pairings that aren't cached are fought
+    std::vector<result> results(pairings.size());
+    std::vector<uint64_t> keys(pairings.size());
+    std::vector<size_t> missing;
+    uint64_t settings = settings_hash();
+    for (size_t p = 0; p < pairings.size(); ++p)
+    {
+        if (cache != nullptr)
+        {
+            keys[p] = util::hash(util::hash(settings, pairings[p].first->hash()), pairings[p].second->hash());
+            if (cache->find(keys[p], results[p])) continue;
         }
-        catch (std::exception ex)
+
+        missing.push_back(p);
+    }
+
+    // Chunk c of the n-th missing pairing has the index n * chunks + c. Every chunk jumps to the seed of its first
+    // round, so the results are the same as fighting all rounds of a pairing in one go.
+    uint32_t chunks = chunks_per_pairing(rounds_per_enemy, missing.size());
+    std::vector<result> chunk_results(missing.size() * chunks);
+    run_chunks(chunk_results.size(), chunk_results.data(), [&](size_t i)
+    {
+        const pairing& p = pairings[missing[i / chunks]];
+        size_t c = i % chunks;
+        int first = (int)((uint64_t)rounds_per_enemy * c / chunks);
+        int count = (int)((uint64_t)rounds_per_enemy * (c + 1) / chunks) - first;
+
+        return with_thread_mmars(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, engine, [&](auto& m)
+        {
+            m.set_seed(pairing_seed(*p.first, *p.second));
+            size_t slot = m.add_warrior(p.first);
+            m.add_warrior(p.second);
+            m.run_slice(first, count);
+
+            return m.get_result(slot);
+        });
+    });
+
+    for (size_t i = 0; i < chunk_results.size(); ++i)
+    {
+        results[missing[i / chunks]] += chunk_results[i];
+    }
+
+    if (cache != nullptr)
+    {
+        for (size_t p : missing)
         {
-            printf("ERROR: (%s) %s\n", entry.path().string().c_str(), ex.what());
+            cache->insert(keys[p], results[p]);
         }
+        cache->save();
     }
+
+    return results;
 }
 
-std::any benchmark::run(const std::shared_ptr<warrior>& target)
+std::vector<benchmark_result> benchmark::run_many(const std::vector<std::shared_ptr<warrior>>& targets, bool per_enemy)
 {
-    result sum;
+    size_t enemies = warriors.size();
 
-    if(_pool != nullptr)
+    // Pairing t * enemies + e is target t against enemy e
+    std::vector<pairing> pairings;
+    pairings.reserve(targets.size() * enemies);
+    for (auto && target : targets)
     {
-        std::vector<std::future<result>> results;
         for (auto && enemy : warriors)
         {
-            results.push_back(_pool->enqueue_work([&]()
+            pairings.emplace_back(target, enemy);
+        }
+    }
+
+    std::vector<result> results = run_pairings(pairings);
+
+    std::vector<benchmark_result> scores(targets.size());
+    for (size_t t = 0; t < targets.size(); ++t)
+    {
+        for (size_t e = 0; e < enemies; ++e)
+        {
+            const result& res = results[t * enemies + e];
+
+            scores[t].total += res;
+            if (per_enemy) scores[t].enemies.push_back(res);
+        }
+
+        scores[t].rounds = (uint64_t)rounds_per_enemy * enemies;
+        scores[t].score = score_calc(scores[t].total, rounds_per_enemy, (int)enemies);
+    }
+
+    return scores;
+}
+
+benchmark_result benchmark::run_threshold(const std::shared_ptr<warrior>& target, const std::any& threshold)
+{
+    int enemies = (int)warriors.size();
+    uint32_t total = rounds_per_enemy * (uint32_t)enemies;
+    uint32_t chunks = chunks_per_pairing(rounds_per_enemy, warriors.size());
+
+    // Rounds that weren't won so far. Both only grow, so a stale read can only overestimate the best reachable score.
+    std::atomic<uint32_t> losses(0);
+    std::atomic<uint32_t> ties(0);
+    std::atomic<bool> rejected(false);
+
+    auto reachable = [&](uint32_t loss, uint32_t tie)
+    {
+        return score_calc(result(total - loss - tie, loss, tie), rounds_per_enemy, enemies);
+    };
+
+    benchmark_result res;
+    if (score_less(reachable(0, 0), threshold))
+    {
+        res.score = reachable(0, 0);
+        res.rejected = true;
+        return res;
+    }
+
+    // Same chunks as run_many, but the rounds are fought one by one so a chunk stops right after the rejection
+    std::vector<result> results(warriors.size() * chunks);
+    run_chunks(results.size(), results.data(), [&](size_t i)
+    {
+        size_t c = i % chunks;
+        int first = (int)((uint64_t)rounds_per_enemy * c / chunks);
+        int end = (int)((uint64_t)rounds_per_enemy * (c + 1) / chunks);
+
+        return with_thread_mmars(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, engine, [&](auto& m)
+        {
+            result sum;
+            size_t slot = m.add_warrior(target);
+            m.add_warrior(warriors[i / chunks]);
+
+            uint32_t pairing = pairing_seed(*target, *warriors[i / chunks]);
+            for (int r = first; r < end && !rejected; ++r)
+            {
+                m.set_seed(pairing);
+                m.run_slice(r, 1);
+
+                result round = m.get_result(slot);
+                sum += round;
+
+                if (round.win > 0) continue;
+                uint32_t loss = losses += round.loss;
+                uint32_t tie = ties += round.tie;
+                if (score_less(reachable(loss, tie), threshold)) rejected = true;
+            }
+
+            return sum;
+        });
+    });
+
+    for (auto && r : results)
+    {
+        res.total += r;
+    }
+
+    res.rounds = (uint64_t)res.total.win + res.total.loss + res.total.tie;
+    res.rejected = rejected;
+    res.score = rejected ? reachable(losses, ties) : score_calc(res.total, rounds_per_enemy, enemies);
+    return res;
+}
+
+benchmark_result benchmark::run_adaptive(const std::shared_ptr<warrior>& target, float half_width, uint32_t max_rounds, float z)
+{
+    benchmark_result res;
+    res.enemies.resize(warriors.size());
+    max_rounds = std::max(max_rounds, rounds_per_enemy);
+
+    std::vector<size_t> active(warriors.size());
+    for (size_t e = 0; e < active.size(); ++e)
+    {
+        active[e] = e;
+    }
+
+    // Every step fights the next rounds of all pairings that aren't settled yet, so they all have the same round count
+    uint32_t fought = 0;
+    while (!active.empty() && rounds_per_enemy > 0)
+    {
+        uint32_t step = std::min(rounds_per_enemy, max_rounds - fought);
+        uint32_t chunks = chunks_per_pairing(step, active.size());
+
+        std::vector<result> results(active.size() * chunks);
+        run_chunks(results.size(), results.data(), [&](size_t i)
+        {
+            size_t c = i % chunks;
+            int first = (int)(fought + (uint64_t)step * c / chunks);
+            int count = (int)(fought + (uint64_t)step * (c + 1) / chunks) - first;
+
+            return with_thread_mmars(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, engine, [&](auto& m)
             {
-                mmars m(core_size, max_cycles, max_process, max_length, min_separation);
-                if (read_limit > 0) m.read_limit = read_limit;
-                if (write_limit > 0) m.write_limit = write_limit;
+                const auto& enemy = warriors[active[i / chunks]];
 
-                m.set_seed((uint32_t)time(nullptr));
-                m.add_warrior(target);
+                m.set_seed(pairing_seed(*target, *enemy));
+                size_t slot = m.add_warrior(target);
                 m.add_warrior(enemy);
-                m.run(rounds_per_enemy);
+                m.run_slice(first, count);
 
-                return m.get_result(target);
-            }));
+                return m.get_result(slot);
+            });
+        });
+
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            res.enemies[active[i / chunks]] += results[i];
         }
+        fought += step;
 
-        for (auto && res : results)
+        std::vector<size_t> unsettled;
+        for (size_t e : active)
         {
-            res.wait();
-            result r = res.get();
-            sum.win += r.win;
-            sum.loss += r.loss;
-            sum.tie += r.tie;
+            const result& r = res.enemies[e];
+            double width = std::max({ wilson_half_width(r.win, fought, z), wilson_half_width(r.loss, fought, z), wilson_half_width(r.tie, fought, z) });
+            if (fought < max_rounds && width > half_width) unsettled.push_back(e);
         }
+        active.swap(unsettled);
     }
-    else
+
+    // Pairings have different round counts, so each one is scaled to max_rounds before scoring
+    result scaled;
+    for (auto && r : res.enemies)
     {
-        mmars m(core_size, max_cycles, max_process, max_length, min_separation);
-        if (read_limit > 0) m.read_limit = read_limit;
-        if (write_limit > 0) m.write_limit = write_limit;
+        uint32_t rounds = r.win + r.loss + r.tie;
+        res.total += r;
+        res.rounds += rounds;
 
-        for (auto && enemy : warriors)
+        if (rounds == 0) continue;
+        scaled += result((uint32_t)std::lround((double)r.win * max_rounds / rounds),
+            (uint32_t)std::lround((double)r.loss * max_rounds / rounds),
+            (uint32_t)std::lround((double)r.tie * max_rounds / rounds));
+    }
+
+    res.score = score_calc(scaled, max_rounds, (int)warriors.size());
+    return res;
+}
+
+result benchmark::sweep_enemies(const std::shared_ptr<warrior>& target, const std::vector<std::shared_ptr<warrior>>& enemies)
+{
+    uint32_t rounds = sweep_rounds();
+    uint32_t chunks = chunks_per_pairing(rounds, enemies.size());
+
+    // Chunk c of enemy e has the index e * chunks + c
+    std::vector<result> results(enemies.size() * chunks);
+    run_chunks(results.size(), results.data(), [&](size_t i)
+    {
+        size_t c = i % chunks;
+        uint32_t first = (uint32_t)((uint64_t)rounds * c / chunks);
+        uint32_t count = (uint32_t)((uint64_t)rounds * (c + 1) / chunks) - first;
+
+        return with_thread_mmars(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, engine, [&](auto& m)
         {
-            m.clear();
-            m.set_seed((uint32_t)time(nullptr));
-            m.add_warrior(target);
-            m.add_warrior(enemy);
-            m.run(rounds_per_enemy);
-            
-            result r = m.get_result(target);
-            sum.win += r.win;
-            sum.loss += r.loss;
-            sum.tie += r.tie;
-        }
+            size_t slot = m.add_warrior(target);
+            m.add_warrior(enemies[i / chunks]);
+            m.run_sweep(first, count);
+
+            return m.get_result(slot);
+        });
+    });
+
+    result sum;
+    for (auto && r : results)
+    {
+        sum += r;
     }
 
-    return score_calc(sum, rounds_per_enemy, warriors.size());
+    return sum;
+}
+
+uint32_t benchmark::sweep_rounds() const
+{
+    return mmars(core_size, max_cycles, max_process, max_length, min_separation).sweep_rounds();
+}
+
+result benchmark::sweep(const std::shared_ptr<warrior>& target, const std::shared_ptr<warrior>& enemy)
+{
+    return sweep_enemies(target, { enemy });
+}
+
+std::any benchmark::run_sweep(const std::shared_ptr<warrior>& target)
+{
+    return score_calc(sweep_enemies(target, warriors), sweep_rounds(), warriors.size());
 }
 
 void benchmark::shutdown()
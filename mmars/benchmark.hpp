@@ -1,15 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <any>
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <string>
+#include <utility>
 #include <fstream>
 #include <filesystem>
 
 #include "thread_pool.hpp"
 #include "warrior.hpp"
 #include "mmars.hpp"
+#include "result_cache.hpp"
 
 #ifdef _MSC_VER
 namespace fs = std::experimental::filesystem;
@@ -17,15 +21,74 @@ namespace fs = std::experimental::filesystem;
 namespace fs = std::filesystem;
 #endif
 
+/**
+ * \brief The outcome of benchmarking one warrior.
+ */
+class benchmark_result
+{
+public:
+    /**
+     * \brief The score defined through the score_calc function of the benchmark.
+     */
+    std::any score;
+
+    /**
+     * \brief The results summed over all enemies.
+     */
+    result total;
+
+    /**
+     * \brief The results against each enemy in the order of benchmark::warriors. Only filled if requested.
+     */
+    std::vector<result> enemies;
+
+    /**
+     * \brief The amount of rounds that were fought.
+     */
+    uint64_t rounds = 0;
+
+    /**
+     * \brief True if the benchmark was aborted because the warrior couldn't reach the threshold anymore. In that case
+     * total only contains the fought rounds and score is the best score the warrior could still have reached.
+     */
+    bool rejected = false;
+};
+
 /**
  * \brief Benchmarks a warrior against a set of other warriors. Also supports multi-threading if threads > 1.
  */
 class benchmark
 {
 private:
-    std::shared_ptr<thread_pool<result>> _pool = nullptr;
+    std::shared_ptr<thread_pool> _pool = nullptr;
+    int _threads = 1;
+
+    /**
+     * \brief Returns the amount of chunks the rounds of each pairing are split into.
+     * \param rounds Rounds per pairing
+     * \param pairings Amount of pairings
+     */
+    uint32_t chunks_per_pairing(uint32_t rounds, size_t pairings) const;
+
+    /**
+     * \brief Runs chunk(i) for every i in [0, count) on the pool or serially if the benchmark has no pool.
+     * \param results Receives the result of each chunk
+     */
+    template <typename F>
+    void run_chunks(size_t count, result* results, F&& chunk);
+
+    /**
+     * \brief Sweeps all positions of a warrior against each enemy.
+     * \return The summed results of the target
+     */
+    result sweep_enemies(const std::shared_ptr<warrior>& target, const std::vector<std::shared_ptr<warrior>>& enemies);
 
 public:
+    /**
+     * \brief Two warriors that fight each other. The first one is the benchmarked warrior.
+     */
+    typedef std::pair<std::shared_ptr<warrior>, std::shared_ptr<warrior>> pairing;
+
     uint32_t core_size = 8000;
     uint32_t max_cycles = 80000;
     uint32_t max_process = 8000;
@@ -37,6 +100,35 @@ public:
 
     uint32_t rounds_per_enemy = 100;
 
+    /**
+     * \brief Seed the seeds of the pairings are derived from, or the seed of every pairing if pairing_seeds is false.
+     */
+    uint32_t seed = 0;
+
+    /**
+     * \brief Rounds of a pairing that are fought by one task. 0 splits the pairings so that every thread gets work.
+     * The results don't depend on the chunk size.
+     */
+    uint32_t rounds_per_chunk = 0;
+
+    /**
+     * \brief If true every pairing gets its own seed, derived from the seed and the hashes of both warriors.
+     * Otherwise all pairings start with the same seed. The default makes the results of a pairing reproducible, so a
+     * cache or a hill can reuse them.
+     */
+    bool pairing_seeds = true;
+
+    /**
+     * \brief Results of pairings that were fought before. run and run_many take the pairings they find from the
+     * cache and store the ones they fought.
+     */
+    std::shared_ptr<result_cache> cache = nullptr;
+
+    /**
+     * \brief The engine the mars of the benchmark execute instructions with. Doesn't change the results.
+     */
+    exec_engine engine = exec_engine::table;
+
     std::vector<std::shared_ptr<warrior>> warriors;
 
     /**
@@ -47,9 +139,18 @@ public:
         return std::any(((float)res.win * 3.0f + (float)res.tie) / ((float)warriors * (float)rounds) * 100.0f);
     };
 
+    /**
+     * \brief Returns true if the first score is worse than the second. Has to match the type of score_calc.
+     */
+    std::function<bool(const std::any&, const std::any&)> score_less = [](const std::any& a, const std::any& b)
+    {
+        return std::any_cast<float>(a) < std::any_cast<float>(b);
+    };
+
     benchmark(uint32_t core_size, uint32_t max_cycles, uint32_t max_process, uint32_t max_length,
         uint32_t min_separation, uint32_t read_limit, uint32_t write_limit, uint32_t rounds_per_enemy, int threads = 1)
-        : core_size(core_size),
+        : _threads(std::max(threads, 1)),
+          core_size(core_size),
           max_cycles(max_cycles),
           max_process(max_process),
           max_length(max_length),
@@ -60,7 +161,7 @@ public:
     {
         if(threads > 1)
         {
-            _pool = std::make_shared<thread_pool<result>>(threads);
+            _pool = std::make_shared<thread_pool>(threads);
         }
     }
 
@@ -71,10 +172,25 @@ public:
     void add_warrior(const std::shared_ptr<warrior>& w);
 
     /**
-     * \brief Adds all fitting warriors that are inside the given path to the benchmark.
+     * \brief Returns the seed the rounds of a pairing start with.
+     * \param target The benchmarked warrior
+     * \param enemy The enemy
+     */
+    uint32_t pairing_seed(const warrior& target, const warrior& enemy) const;
+
+    /**
+     * \brief Hashes all settings, the rounds and the seeds. Results of pairings can be reused as long as the
+     * hash and both warriors stay the same.
+     */
+    uint64_t settings_hash() const;
+
+    /**
+     * \brief Adds all fitting warriors that are inside the given path to the benchmark. The files are parsed in
+     * parallel and the warriors are added in the order of their paths.
      * \param path The path to the warriors
+     * \return The errors of the files that couldn't be parsed
      */
-    void add_directory(const std::string& path);
+    std::vector<std::string> add_directory(const std::string& path);
 
     /**
      * \brief Runs a benchmark.
@@ -83,6 +199,67 @@ public:
      */
     std::any run(const std::shared_ptr<warrior>& target);
 
+    /**
+     * \brief Benchmarks many warriors at once. All pairings of all targets are scheduled together, so the threads
+     * don't wait for the slowest pairing of each target.
+     * \param targets The warriors to benchmark
+     * \param per_enemy If true the results against each enemy are returned as well
+     * \return The outcome of each target in the order of targets
+     */
+    std::vector<benchmark_result> run_many(const std::vector<std::shared_ptr<warrior>>& targets, bool per_enemy = false);
+
+    /**
+     * \brief Fights rounds_per_enemy rounds of each pairing. All pairings are scheduled together and the cache is
+     * used if there is one.
+     * \param pairings The pairings to fight
+     * \return The results of the first warrior of each pairing
+     */
+    std::vector<result> run_pairings(const std::vector<pairing>& pairings);
+
+    /**
+     * \brief Benchmarks a warrior but gives up as soon as it can't reach the threshold anymore. The best reachable
+     * score counts all rounds that weren't fought yet as wins, so score_calc has to grow with the wins.
+     * \param target The warrior to benchmark
+     * \param threshold The score the warrior has to reach, with the type defined through the score_calc function
+     * \return The outcome of the target. Check rejected before using the score.
+     */
+    benchmark_result run_threshold(const std::shared_ptr<warrior>& target, const std::any& threshold);
+
+    /**
+     * \brief Benchmarks a warrior with as many rounds per enemy as needed. Every pairing is fought in steps of
+     * rounds_per_enemy rounds until the wilson score intervals of the win, loss and tie rates are all within
+     * the requested half width or max_rounds is reached. With max_rounds = rounds_per_enemy this is the same as run.
+     * The score is calculated as if every enemy was fought max_rounds times with the measured rates.
+     * \param target The warrior to benchmark
+     * \param half_width Maximum half width of the intervals as a fraction of the rounds (e.g. 0.05)
+     * \param max_rounds Maximum rounds per enemy
+     * \param z Quantile of the standard normal distribution for the confidence level (1.96 = 95%)
+     * \return The outcome of the target with the results against each enemy and the rounds that were fought
+     */
+    benchmark_result run_adaptive(const std::shared_ptr<warrior>& target, float half_width, uint32_t max_rounds, float z = 1.96f);
+
+    /**
+     * \brief Returns the amount of rounds of a position sweep with the settings of this benchmark.
+     * \return Rounds per enemy of a sweep
+     */
+    uint32_t sweep_rounds() const;
+
+    /**
+     * \brief Fights two warriors at every legal position with both move orders.
+     * \param target The warrior to benchmark
+     * \param enemy The enemy
+     * \return The results of the target
+     */
+    result sweep(const std::shared_ptr<warrior>& target, const std::shared_ptr<warrior>& enemy);
+
+    /**
+     * \brief Runs a benchmark that sweeps all positions against each warrior instead of fighting random rounds.
+     * Scores are exact and can be compared between runs.
+     * \param target The warrior to benchmark
+     * \return A any with the type defined through the score_calc function
+     */
+    std::any run_sweep(const std::shared_ptr<warrior>& target);
+
     /**
      * \brief If the benchmark uses multiple threads this will free the thread pool.
      * Benchmark will be unusable after calling this function.
@@ -0,0 +1,181 @@
+#include "hill.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+static const char hill_magic[4] = { 'M', 'M', 'H', 'L' };
+static const uint32_t hill_version = 1;
+
+size_t hill::add(benchmark& b, const std::vector<std::shared_ptr<warrior>>& challengers)
+{
+    size_t old_size = _warriors.size();
+    size_t new_size = old_size + challengers.size();
+
+    // Grow the matrix and keep the old results
+    std::vector<result> matrix(new_size * new_size);
+    for (size_t r = 0; r < old_size; ++r)
+    {
+        for (size_t c = 0; c < old_size; ++c)
+        {
+            matrix[r * new_size + c] = _matrix[r * old_size + c];
+        }
+    }
+    _matrix.swap(matrix);
+    _warriors.insert(_warriors.end(), challengers.begin(), challengers.end());
+
+    if (_settings != 0 && _settings != b.settings_hash()) _stored.clear();
+
+    // Every new warrior fights all warriors before it once
+    std::vector<benchmark::pairing> pairings;
+    std::vector<std::pair<size_t, size_t>> cells;
+    for (size_t r = old_size; r < new_size; ++r)
+    {
+        uint64_t row_hash = _warriors[r]->hash();
+        for (size_t c = 0; c < r; ++c)
+        {
+            auto stored = _stored.find({ row_hash, _warriors[c]->hash() });
+            if (stored != _stored.end())
+            {
+                _matrix[r * new_size + c] = stored->second;
+                _matrix[c * new_size + r] = result(stored->second.loss, stored->second.win, stored->second.tie);
+                continue;
+            }
+
+            pairings.emplace_back(_warriors[r], _warriors[c]);
+            cells.emplace_back(r, c);
+        }
+    }
+
+    std::vector<result> results = b.run_pairings(pairings);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        size_t r = cells[i].first;
+        size_t c = cells[i].second;
+        _matrix[r * new_size + c] = results[i];
+        _matrix[c * new_size + r] = result(results[i].loss, results[i].win, results[i].tie);
+    }
+
+    return pairings.size();
+}
+
+void hill::remove(size_t index)
+{
+    if (index >= _warriors.size()) throw std::runtime_error("warrior is not on the hill");
+
+    size_t old_size = _warriors.size();
+    std::vector<result> matrix;
+    matrix.reserve((old_size - 1) * (old_size - 1));
+    for (size_t r = 0; r < old_size; ++r)
+    {
+        if (r == index) continue;
+        for (size_t c = 0; c < old_size; ++c)
+        {
+            if (c != index) matrix.push_back(_matrix[r * old_size + c]);
+        }
+    }
+
+    _matrix.swap(matrix);
+    _warriors.erase(_warriors.begin() + index);
+}
+
+const result& hill::get(size_t a, size_t b) const
+{
+    return _matrix[a * _warriors.size() + b];
+}
+
+result hill::total(size_t index) const
+{
+    result sum;
+    for (size_t c = 0; c < _warriors.size(); ++c)
+    {
+        sum += get(index, c);
+    }
+
+    return sum;
+}
+
+std::any hill::score(const benchmark& b, size_t index) const
+{
+    return b.score_calc(total(index), b.rounds_per_enemy, (int)std::max<size_t>(_warriors.size(), 2) - 1);
+}
+
+size_t hill::size() const
+{
+    return _warriors.size();
+}
+
+const std::vector<std::shared_ptr<warrior>>& hill::warriors() const
+{
+    return _warriors;
+}
+
+void hill::save(const benchmark& b, const std::string& path) const
+{
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) throw std::runtime_error("can't write hill: " + path);
+
+    uint64_t settings = b.settings_hash();
+    uint64_t count = _warriors.size();
+    f.write(hill_magic, 4);
+    f.write((const char*)&hill_version, sizeof(uint32_t));
+    f.write((const char*)&settings, sizeof(uint64_t));
+    f.write((const char*)&count, sizeof(uint64_t));
+
+    for (auto && w : _warriors)
+    {
+        uint64_t h = w->hash();
+        f.write((const char*)&h, sizeof(uint64_t));
+    }
+
+    for (auto && res : _matrix)
+    {
+        uint32_t cell[3] = { res.win, res.loss, res.tie };
+        f.write((const char*)cell, sizeof(cell));
+    }
+
+    if (!f) throw std::runtime_error("can't write hill: " + path);
+}
+
+void hill::load(const benchmark& b, const std::string& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open()) return;
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t settings = 0;
+    uint64_t count = 0;
+    f.read(magic, 4);
+    f.read((char*)&version, sizeof(uint32_t));
+    f.read((char*)&settings, sizeof(uint64_t));
+    f.read((char*)&count, sizeof(uint64_t));
+    if (!f || std::char_traits<char>::compare(magic, hill_magic, 4) != 0 || version != hill_version)
+        throw std::runtime_error("not a hill of this version: " + path);
+
+    // Results of other settings can't be reused
+    _settings = b.settings_hash();
+    if (settings != _settings) return;
+
+    // The count is checked against the size of the file before anything is allocated for it
+    std::streamoff header = f.tellg();
+    f.seekg(0, std::ios::end);
+    uint64_t remaining = (uint64_t)(f.tellg() - header);
+    f.seekg(header);
+    uint64_t cells = count == 0 ? 0 : (remaining - std::min(remaining, count * sizeof(uint64_t))) / (3 * sizeof(uint32_t)) / count;
+    if (!f || count > remaining / sizeof(uint64_t) || cells < count) throw std::runtime_error("hill file is truncated: " + path);
+
+    std::vector<uint64_t> hashes(count);
+    if (!f.read((char*)hashes.data(), (std::streamsize)(count * sizeof(uint64_t))))
+        throw std::runtime_error("hill file is truncated: " + path);
+
+    for (uint64_t r = 0; r < count; ++r)
+    {
+        for (uint64_t c = 0; c < count; ++c)
+        {
+            uint32_t cell[3];
+            if (!f.read((char*)cell, sizeof(cell))) throw std::runtime_error("hill file is truncated: " + path);
+            if (r != c) _stored[{ hashes[r], hashes[c] }] = result(cell[0], cell[1], cell[2]);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "warrior.hpp"
+
+/**
+ * \brief A round robin tournament. Every warrior fights every other warrior once, the result of the other side
+ * is mirrored. Adding a challenger only fights its pairings against the warriors that are already on the hill.
+ */
+class hill
+{
+private:
+    std::vector<std::shared_ptr<warrior>>   _warriors;
+
+    /**
+     * \brief Result of warrior row against warrior column, row-major. The diagonal stays empty.
+     */
+    std::vector<result>                     _matrix;
+
+    /**
+     * \brief Results that were loaded from a file, keyed by the hashes of both warriors.
+     */
+    std::map<std::pair<uint64_t, uint64_t>, result> _stored;
+    uint64_t                                _settings = 0;
+
+public:
+    /**
+     * \brief Adds warriors to the hill and fights all new pairings on the benchmark in one batch. Pairings that
+     * were loaded from a file aren't fought again.
+     * \param b The benchmark that defines the settings and threads
+     * \param challengers The warriors to add
+     * \return The amount of pairings that were fought
+     */
+    size_t add(benchmark& b, const std::vector<std::shared_ptr<warrior>>& challengers);
+
+    /**
+     * \brief Removes a warrior and its results from the hill.
+     */
+    void remove(size_t index);
+
+    /**
+     * \brief Returns the result of warrior a against warrior b.
+     */
+    const result& get(size_t a, size_t b) const;
+
+    /**
+     * \brief Returns the results of a warrior summed over all other warriors.
+     */
+    result total(size_t index) const;
+
+    /**
+     * \brief Returns the score of a warrior defined through the score_calc function of the benchmark.
+     */
+    std::any score(const benchmark& b, size_t index) const;
+
+    /**
+     * \brief Returns the amount of warriors on the hill.
+     */
+    size_t size() const;
+
+    /**
+     * \brief Returns the warriors in the order they were added.
+     */
+    const std::vector<std::shared_ptr<warrior>>& warriors() const;
+
+    /**
+     * \brief Writes the hashes of all warriors and the result matrix to a file.
+     * \param b The benchmark whose settings were used for the results
+     */
+    void save(const benchmark& b, const std::string& path) const;
+
+    /**
+     * \brief Loads the results of a file that was written by save. The warriors have to be added afterwards,
+     * their pairings are then taken from the file. Nothing is loaded if the file doesn't exist.
+     * \param b The benchmark that will be used, its settings have to match the ones of the file
+     */
+    void load(const benchmark& b, const std::string& path);
+};
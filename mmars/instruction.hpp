@@ -1,12 +1,13 @@
 #pragma once
 
 #include <cstdint>
+#include <type_traits>
 
 /**
  * \brief A redcode opcode.
  */
 enum class op_code : char {
-    dat, nop, spl, 
+    dat, nop, spl,
     jmp, mov, add,
     sub, mul, div,
     mod, jmz, jmn,
@@ -18,7 +19,7 @@ enum class op_code : char {
  * \brief A redcode modifier.
  */
 enum modifier : char {
-    i, a, b, ab, ba, f, x 
+    i, a, b, ab, ba, f, x
 };
 
 /**
@@ -36,65 +37,66 @@ enum addr_mode : char {
 };
 
 /**
- * \brief A redcode instruction.
+ * \brief A redcode instruction. Opcode, modifier and both addressing modes are packed into a single 16 bit code
+ * (4 bit opcode, 3 bit modifier, 3 bit a-mode, 3 bit b-mode) that can directly be used to dispatch the instruction.
+ * \tparam T Type of the a and b field
  */
-class instruction
+template <typename T>
+class basic_instruction
 {
 public:
-    addr_mode   a_mode;
-    addr_mode   b_mode;
-    op_code     op;
-    modifier    mod;
-    uint32_t    a;
-    uint32_t    b;
+    uint16_t    code;
+    T           a;
+    T           b;
 
-    instruction(op_code op, modifier mod, addr_mode a_mode, uint32_t a, addr_mode b_mode, uint32_t b)
+    /**
+     * \brief Packs opcode, modifier and addressing modes into a instruction code.
+     */
+    static constexpr uint16_t encode(op_code op, modifier mod, addr_mode a_mode, addr_mode b_mode)
     {
-        this->op        = op;
-        this->mod       = mod;
-        this->a_mode    = a_mode;
-        this->a         = a;
-        this->b_mode    = b_mode;
-        this->b         = b;
+        return (uint16_t)((uint16_t)op << 9 | (uint16_t)mod << 6 | (uint16_t)a_mode << 3 | (uint16_t)b_mode);
     }
 
-    instruction() : instruction(op_code::dat, modifier::f, addr_mode::dir, 0, addr_mode::dir, 0)
+    basic_instruction(op_code op, modifier mod, addr_mode a_mode, T a, addr_mode b_mode, T b)
+        : code(encode(op, mod, a_mode, b_mode)),
+          a(a),
+          b(b)
     { }
 
-    instruction(const instruction& other) = default;
+    basic_instruction() : basic_instruction(op_code::dat, modifier::f, addr_mode::dir, 0, addr_mode::dir, 0)
+    { }
 
-    instruction(instruction&& other) noexcept
-        : op(other.op),
-          mod(other.mod),
-          a_mode(other.a_mode),
-          a(other.a),
-          b_mode(other.b_mode),
-          b(other.b)
+    /**
+     * \brief Converts a instruction with a different field type.
+     */
+    template <typename U>
+    explicit basic_instruction(const basic_instruction<U>& other)
+        : code(other.code),
+          a((T)other.a),
+          b((T)other.b)
     { }
 
-    instruction& operator=(const instruction& other)
-    {
-        if (this == &other)
-            return *this;
-        op = other.op;
-        mod = other.mod;
-        a_mode = other.a_mode;
-        a = other.a;
-        b_mode = other.b_mode;
-        b = other.b;
-        return *this;
-    }
+    op_code op() const { return (op_code)(code >> 9); }
+    modifier mod() const { return (modifier)(code >> 6 & 7); }
+    addr_mode a_mode() const { return (addr_mode)(code >> 3 & 7); }
+    addr_mode b_mode() const { return (addr_mode)(code & 7); }
 
-    instruction& operator=(instruction&& other) noexcept
-    {
-        if (this == &other)
-            return *this;
-        op = other.op;
-        mod = other.mod;
-        a_mode = other.a_mode;
-        a = other.a;
-        b_mode = other.b_mode;
-        b = other.b;
-        return *this;
-    }
-};
\ No newline at end of file
+    void set_op(op_code op) { code = encode(op, mod(), a_mode(), b_mode()); }
+    void set_mod(modifier mod) { code = encode(op(), mod, a_mode(), b_mode()); }
+    void set_a_mode(addr_mode a_mode) { code = encode(op(), mod(), a_mode, b_mode()); }
+    void set_b_mode(addr_mode b_mode) { code = encode(op(), mod(), a_mode(), b_mode); }
+};
+
+/**
+ * \brief A instruction with 32 bit fields. Used by the parser, warriors and cores of any size.
+ */
+typedef basic_instruction<uint32_t> instruction;
+
+/**
+ * \brief A instruction with 16 bit fields. Used by cores with up to 65536 cells.
+ */
+typedef basic_instruction<uint16_t> compact_instruction;
+
+static_assert(std::is_trivially_copyable<instruction>::value, "instruction has to be trivially copyable");
+static_assert(std::is_trivially_copyable<compact_instruction>::value, "compact_instruction has to be trivially copyable");
+static_assert(sizeof(compact_instruction) == 6, "compact_instruction has to be packed into 6 bytes");
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <fstream>
 #include <chrono>
 
@@ -5,6 +6,7 @@
 #include "parser.hpp"
 #include "cli11.hpp"
 #include "benchmark.hpp"
+#include "hill.hpp"
 
 int main(int argc, char *argv[])
 {
@@ -32,6 +34,8 @@ int main(int argc, char *argv[])
     int initial_pos = 0;
 
     bool only_assemble = false;
+    bool sweep = false;
+    std::string engine = "table";
 
     app.add_option("-s,--s,--core_size", core_size, "Core size");
     app.add_option("-c,--c,--max_cycle", max_cycles, "Maximum cycles");
@@ -43,11 +47,23 @@ int main(int argc, char *argv[])
     app.add_option("-a,--asm,--assemble", only_assemble, "Just saves the assembled warriors");
     app.add_option("--rl,--read_limit", read_limit, "Read limit (defaults to core size)");
     app.add_option("--wl,--write_limit", write_limit, "Write limit (defaults to core size)");
+    app.add_option("-e,--engine", engine, "Execution engine (table or interpreter)");
+    app.add_flag("--sweep", sweep, "Fight every legal position with both move orders instead of random rounds");
 
     int benchmark_threads = std::max(1, (int)std::thread::hardware_concurrency());
     std::string benchmark_path = "";
+    float threshold = -1.0f;
+    float confidence = 0.0f;
+    int max_rounds = 0;
+    std::string cache_path = "";
+    std::string hill_path = "";
     app.add_option("-b,--b,--bench_path", benchmark_path, "The path to a folder that contains the warriors to benchmark against");
-    app.add_option("-t,--t,--bench_threads", benchmark_threads, "The amount of threads to use for the benchmark");
+    app.add_option("-t,--t,--bench_threads", benchmark_threads, "The amount of threads to use for the benchmark and for the rounds of a two warrior fight");
+    app.add_option("--threshold", threshold, "Stop the benchmark as soon as the warrior can't reach this score anymore");
+    app.add_option("--confidence", confidence, "Fight each enemy in steps of --rounds until the 95% confidence intervals of the rates are this narrow (e.g. 0.05)");
+    app.add_option("--max_rounds", max_rounds, "Maximum rounds per enemy for --confidence (defaults to 10 times --rounds)");
+    app.add_option("--cache", cache_path, "A file that stores the benchmark results of each pairing for later runs");
+    app.add_option("--hill", hill_path, "Fights a round robin between the warriors and the warriors of --bench_path. The result matrix is kept in this file, so only new warriors have to fight");
 
     try {
         app.parse(argc, argv);
@@ -56,13 +72,20 @@ int main(int argc, char *argv[])
         return app.exit(e);
     }
 
-    if(warrior_paths.empty())
+    if(warrior_paths.empty() && hill_path.empty())
     {
         printf(app.help().c_str());
         return 0;
     }
 
-    if(!benchmark_path.empty() && warrior_paths.size() > 1)
+    if(engine != "table" && engine != "interpreter")
+    {
+        printf("Unknown engine: %s", engine.c_str());
+        return 0;
+    }
+    exec_engine selected_engine = engine == "table" ? exec_engine::table : exec_engine::interpreter;
+
+    if(!benchmark_path.empty() && hill_path.empty() && warrior_paths.size() > 1)
     {
         printf("You can only benchmark one warrior. Please try again with one warrior path!");
         return 0;
@@ -109,61 +132,172 @@ int main(int argc, char *argv[])
     if (only_assemble) return 0;
 
     /*
-     * Benchmark
+     * Hill
      */
-    if (!benchmark_path.empty())
+    if (!hill_path.empty())
     {
         benchmark b(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, rounds, benchmark_threads);
-        b.add_directory(benchmark_path);
+        b.engine = selected_engine;
+        if (!benchmark_path.empty())
+        {
+            for (auto && error : b.add_directory(benchmark_path)) printf("ERROR: %s\n", error.c_str());
+        }
+
+        if (initial_pos > 0)
+        {
+            b.seed = initial_pos - min_separation;
+            b.pairing_seeds = false;
+        }
+
+        std::vector<std::shared_ptr<warrior>> challengers = b.warriors;
+        challengers.insert(challengers.end(), parsed.begin(), parsed.end());
+
+        hill h;
+        try
+        {
+            h.load(b, hill_path);
+        }
+        catch (const std::exception& ex)
+        {
+            printf("ERROR: %s\n", ex.what());
+            return 1;
+        }
 
         std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-        float res = std::any_cast<float>(b.run(parsed[0]));
+        size_t fought = h.add(b, challengers);
         int64_t time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
 
         b.shutdown();
+        h.save(b, hill_path);
 
-        if (parsed[0]->name.empty()) printf("Warrior=%-20d score=%.03f\n", i, res);
-        else printf("Warrior=%-20s score=%.03f\n", parsed[0]->name.c_str(), res);
-        printf("Finished in %lldms (%.2fms/round)", time_taken, (float)time_taken / (float)(rounds * b.warriors.size()));
+        std::vector<size_t> ranking(h.size());
+        for (size_t i = 0; i < ranking.size(); ++i) ranking[i] = i;
+        std::stable_sort(ranking.begin(), ranking.end(), [&](size_t x, size_t y) { return b.score_less(h.score(b, y), h.score(b, x)); });
+
+        for (size_t i = 0; i < ranking.size(); ++i)
+        {
+            printf("%3zu. Warrior=%-20s score=%.03f\n", i + 1, h.warriors()[ranking[i]]->name.c_str(), std::any_cast<float>(h.score(b, ranking[i])));
+        }
+        printf("Fought %zu pairings in %lldms", fought, (long long)time_taken);
 
         return 0;
     }
 
     /*
-     * Create Mars
+     * Benchmark
      */
-    mmars m(core_size, max_cycles, max_process, max_length, min_separation);
-    if (read_limit > 0) m.read_limit = read_limit;
-    if (write_limit > 0) m.write_limit = write_limit;
-
-    for (auto && w : parsed)
+    if (!benchmark_path.empty())
     {
-        m.add_warrior(w);
+        benchmark b(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, rounds, benchmark_threads);
+        b.engine = selected_engine;
+        for (auto && error : b.add_directory(benchmark_path)) printf("ERROR: %s\n", error.c_str());
+        if (initial_pos > 0)
+        {
+            b.seed = initial_pos - min_separation;
+            b.pairing_seeds = false;
+        }
+
+        if (!cache_path.empty())
+        {
+            try
+            {
+                b.cache = std::make_shared<result_cache>(cache_path);
+            }
+            catch (const std::exception& ex)
+            {
+                printf("ERROR: %s\n", ex.what());
+                return 1;
+            }
+        }
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        benchmark_result res;
+        if (sweep) res.score = b.run_sweep(parsed[0]);
+        else if (threshold >= 0.0f) res = b.run_threshold(parsed[0], threshold);
+        else if (confidence > 0.0f) res = b.run_adaptive(parsed[0], confidence, max_rounds > 0 ? max_rounds : rounds * 10);
+        else res.score = b.run(parsed[0]);
+        int64_t time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        b.shutdown();
+
+        uint32_t rounds_per_enemy = sweep ? b.sweep_rounds() : rounds;
+        float score = std::any_cast<float>(res.score);
+        if (res.rejected) printf("Warrior=%-20s rejected (best reachable score=%.03f)\n", parsed[0]->name.c_str(), score);
+        else if (parsed[0]->name.empty()) printf("Warrior=%-20d score=%.03f\n", i, score);
+        else printf("Warrior=%-20s score=%.03f\n", parsed[0]->name.c_str(), score);
+        if (confidence > 0.0f) printf("Fought %llu rounds (%.1f per enemy)\n", (unsigned long long)res.rounds, (double)res.rounds / b.warriors.size());
+        printf("Finished in %lldms (%.2fms/round)", (long long)time_taken, (float)time_taken / (float)(res.rounds > 0 ? res.rounds : rounds_per_enemy * b.warriors.size()));
+
+        return 0;
     }
 
     /*
-     * Seed
+     * Position Sweep
      */
-    if (initial_pos > 0) m.set_seed(initial_pos - min_separation);
-    else m.set_seed((uint32_t)time(nullptr));
+    if (sweep)
+    {
+        if (parsed.size() != 2)
+        {
+            printf("A position sweep needs exactly two warriors!");
+            return 0;
+        }
 
-    /*
-     * Simulate
-     */
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-    m.run(rounds);
-    int64_t time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+        benchmark b(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, rounds, benchmark_threads);
+        b.engine = selected_engine;
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        result res = b.sweep(parsed[0], parsed[1]);
+        int64_t time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        b.shutdown();
+
+        result results[] = { res, result(res.loss, res.win, res.tie) };
+        for (int i = 0; i < 2; ++i)
+        {
+            if (parsed[i]->name.empty()) printf("Warrior=%-20d win=%u loss=%u tie=%u\n", i, results[i].win, results[i].loss, results[i].tie);
+            else printf("Warrior=%-20s win=%u loss=%u tie=%u\n", parsed[i]->name.c_str(), results[i].win, results[i].loss, results[i].tie);
+        }
+        printf("Finished in %lldms (%.2fms/round)", (long long)time_taken, (float)time_taken / (float)b.sweep_rounds());
+
+        return 0;
+    }
 
     /*
-     * Print Results
-    */
-    int i = 0;
-    for (auto && warrior : parsed)
+     * Create Mars
+     */
+    with_mmars(core_size, max_cycles, max_process, max_length, min_separation, read_limit, write_limit, [&](auto& m)
     {
-        auto res = m.get_result(warrior);
-        if (warrior->name.empty()) printf("Warrior=%-20d win=%d loss=%d tie=%d\n", i, res.win, res.loss, res.tie);
-        else printf("Warrior=%-20s win=%d loss=%d tie=%d\n", warrior->name.c_str(), res.win, res.loss, res.tie);
-        i++;
-    }
-    printf("Finished in %lldms (%.2fms/round)", time_taken, (float)time_taken / (float)rounds);
+        m.engine = selected_engine;
+
+        for (auto && w : parsed)
+        {
+            m.add_warrior(w);
+        }
+
+        /*
+         * Seed
+         */
+        if (initial_pos > 0) m.set_seed(initial_pos - min_separation);
+        else m.set_seed((uint32_t)time(nullptr));
+
+        /*
+         * Simulate
+         */
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        m.run_parallel(rounds, benchmark_threads);
+        int64_t time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+
+        /*
+         * Print Results
+        */
+        int i = 0;
+        for (auto && warrior : parsed)
+        {
+            auto res = m.get_result(i);
+            if (warrior->name.empty()) printf("Warrior=%-20d win=%u loss=%u tie=%u\n", i, res.win, res.loss, res.tie);
+            else printf("Warrior=%-20s win=%u loss=%u tie=%u\n", warrior->name.c_str(), res.win, res.loss, res.tie);
+            i++;
+        }
+        printf("Finished in %lldms (%.2fms/round, %.0f instructions/s)", (long long)time_taken, (float)time_taken / (float)rounds, (double)m.executed() / std::max((double)time_taken, 1.0) * 1000.0);
+    });
 }
@@ -1,24 +1,33 @@
 #pragma once
 
+#include <array>
+#include <limits>
 #include <memory>
+#include <thread>
 #include <vector>
 #include <queue>
-#include <unordered_map>
+#include <utility>
 
 #include "warrior.hpp"
 #include "task_queue.hpp"
 
+#ifdef _MSC_VER
+#define force_inline __forceinline
+#else
+#define force_inline inline __attribute__((always_inline))
+#endif
+
 /**
  * \brief Represents a fighting result
  */
 class result
 {
 public:
-    uint16_t win = 0;
-    uint16_t loss = 0;
-    uint16_t tie = 0;
+    uint32_t win = 0;
+    uint32_t loss = 0;
+    uint32_t tie = 0;
 
-    result(uint16_t win, uint16_t loss, uint16_t tie)
+    result(uint32_t win, uint32_t loss, uint32_t tie)
         : win(win),
           loss(loss),
           tie(tie)
@@ -26,29 +35,138 @@ public:
     }
 
     result() = default;
+
+    result& operator+=(const result& other)
+    {
+        win += other.win;
+        loss += other.loss;
+        tie += other.tie;
+        return *this;
+    }
+};
+
+/**
+ * \brief The engine that is used to execute instructions.
+ */
+enum class exec_engine : char {
+    interpreter, // decodes every instruction through nested switches
+    table        // jumps to a pre-resolved handler for each op / modifier / mode combination
 };
 
 /**
  * \brief The mars implementation
+ * \tparam T Type of the a and b fields of the core cells. Limits the maximum core size.
+ * \tparam CORE_SIZE Core size known at compile time or 0 if the core size is set at runtime
+ * \tparam READ_LIMIT Read limit known at compile time (only used if CORE_SIZE is not 0)
+ * \tparam WRITE_LIMIT Write limit known at compile time (only used if CORE_SIZE is not 0)
  */
-class mmars
+template <typename T, uint32_t CORE_SIZE = 0, uint32_t READ_LIMIT = CORE_SIZE, uint32_t WRITE_LIMIT = READ_LIMIT>
+class basic_mmars
 {
+    static_assert(CORE_SIZE == 0 || (READ_LIMIT != 0 && WRITE_LIMIT != 0), "a fixed core size needs fixed limits");
+    static_assert(CORE_SIZE <= (uint64_t)std::numeric_limits<T>::max() + 1, "core size doesn't fit into the field type");
+
 private:
+    typedef basic_instruction<T> cell;
+    typedef typename std::conditional<sizeof(T) <= 2, uint32_t, uint64_t>::type wide;
+    typedef void (*op_handler)(basic_mmars& m, uint32_t ri, uint32_t pc);
+
+    static constexpr size_t handler_count = 1 << 13;
+    static constexpr uint32_t dirty_block_shift = 6;
+    static constexpr uint32_t dirty_block_size = 1 << dirty_block_shift;
+    static const std::array<op_handler, handler_count> _handlers;
+
     int                                                     _seed = -1;
     uint16_t                                                _round = 0;
     std::vector<std::shared_ptr<warrior>>                   _warriors;
-    std::unordered_map<std::shared_ptr<warrior>, result>    _results;
-    std::vector<task_queue>                                 _task_queue;
-    std::vector<instruction>                                _core;
+    std::vector<std::vector<cell>>                          _code;
+    std::vector<result>                                     _results;
+    task_queues                                             _tasks;
+    std::vector<cell>                                       _core;
+    std::vector<uint64_t>                                   _dirty;
+    uint64_t                                                _executed = 0;
+    bool                                                    _sweep = false;
+    uint32_t                                                _sweep_position = 0;
 
 
+    /**
+     * \brief Returns the core size. Is a constant if the mars is specialized for a core size.
+     */
+    force_inline uint32_t size() const
+    {
+        if constexpr (CORE_SIZE != 0) return CORE_SIZE;
+        else return core_size;
+    }
+
+    /**
+     * \brief Returns the read limit. Is a constant if the mars is specialized for a core size.
+     */
+    force_inline uint32_t rlimit() const
+    {
+        if constexpr (CORE_SIZE != 0) return READ_LIMIT;
+        else return read_limit;
+    }
+
+    /**
+     * \brief Returns the write limit. Is a constant if the mars is specialized for a core size.
+     */
+    force_inline uint32_t wlimit() const
+    {
+        if constexpr (CORE_SIZE != 0) return WRITE_LIMIT;
+        else return write_limit;
+    }
+
+    /**
+     * \brief Reduces a value in [0, 2 * core size) to [0, core size) without a division.
+     */
+    force_inline uint32_t wrap(uint32_t v) const
+    {
+        return v >= size() ? v - size() : v;
+    }
+
+    /**
+     * \brief Decrements a field value modulo core size.
+     */
+    force_inline uint32_t dec(uint32_t v) const
+    {
+        return v == 0 ? size() - 1 : v - 1;
+    }
+
+    /**
+     * \brief Increments a field value modulo core size.
+     */
+    force_inline uint32_t inc(uint32_t v) const
+    {
+        return v + 1 == size() ? 0 : v + 1;
+    }
+
+    /**
+     * \brief Marks a block of the core as written, so that the next setup() resets it.
+     * \param block Block index (cell index >> dirty_block_shift)
+     */
+    force_inline void mark_dirty(uint32_t block)
+    {
+        _dirty[block >> 6] |= (uint64_t)1 << (block & 63);
+    }
+
+    /**
+     * \brief Returns a cell for writing and marks its block as dirty.
+     * \param i Index of the cell
+     * \return The cell
+     */
+    force_inline cell& write(uint32_t i)
+    {
+        mark_dirty(i >> dirty_block_shift);
+        return _core[i];
+    }
+
     /**
      * \brief Folds a pointer to stay inside the core size and read / write range.
-     * \param ptr Pointer inside the core
+     * \param ptr Pointer inside the core (has to be smaller than 2 * core size)
      * \param limit Limit to fold to
      * \return The folded pointer
      */
-    inline uint32_t fold(uint32_t ptr, uint32_t limit) const;
+    force_inline uint32_t fold(uint32_t ptr, uint32_t limit) const;
 
     /**
      * \brief Enqueue a task into the queue of a warrior.
@@ -57,12 +175,88 @@ private:
      */
     inline void queue(int wi, uint32_t ptr);
 
+    /**
+     * \brief Executes the instruction at pc by decoding it through the nested switches.
+     * \param ri Warrior index
+     * \param pc Address of the instruction
+     */
+    void interpret(uint32_t ri, uint32_t pc);
+
+    /**
+     * \brief Computes the handler table index of an instruction.
+     * \param ir The instruction
+     * \return Index into _handlers
+     */
+    static inline size_t handler_index(const cell& ir);
+
+    /**
+     * \brief Builds the handler table with one entry per op / modifier / a-mode / b-mode combination.
+     */
+    template <size_t... I>
+    static constexpr std::array<op_handler, sizeof...(I)> make_handlers(std::index_sequence<I...>);
+
+    /**
+     * \brief Executes the instruction at pc with op, modifier and modes resolved at compile time.
+     * \param m The mars
+     * \param ri Warrior index
+     * \param pc Address of the instruction
+     */
+    template <op_code OP, modifier MOD, addr_mode A_MODE, addr_mode B_MODE>
+    static void handle(basic_mmars& m, uint32_t ri, uint32_t pc);
+
+    /**
+     * \brief Evaluates a operand and applies its pre-decrement / post-increment.
+     * \param pc Address of the instruction
+     * \param field The a or b field of the instruction
+     * \param rp Resulting read pointer (relative to pc)
+     * \param wp Resulting write pointer (relative to pc)
+     * \return Copy of the instruction the read pointer points to
+     */
+    template <addr_mode MODE>
+    force_inline cell operand(uint32_t pc, uint32_t field, uint32_t& rp, uint32_t& wp);
+
+    /**
+     * \brief Executes the operation of a instruction after both operands have been evaluated.
+     */
+    template <op_code OP, modifier MOD>
+    force_inline void execute(uint32_t ri, uint32_t pc, const cell& ira, cell irb, uint32_t rpa, uint32_t wpb);
+
+    /**
+     * \brief Executes add, sub and mul. op receives the b and a operands and returns the folded result.
+     */
+    template <modifier MOD, typename F>
+    force_inline void execute_arith(uint32_t ri, uint32_t pc, const cell& ira, const cell& irb, uint32_t wpb, F op);
+
+    /**
+     * \brief Executes div and mod. A zero divisor kills the process instead of queueing the next instruction.
+     */
+    template <modifier MOD, typename F>
+    force_inline void execute_div(uint32_t ri, uint32_t pc, const cell& ira, const cell& irb, uint32_t wpb, F op);
+
     /**
      * \brief Implements a minimal random number generator. Source is borrowed from pmars to be able to reproduce deterministic results equal to pmars or exmars.
      * \return Next random number
      */
     int random();
 
+    /**
+     * \brief Computes the next state of the random number generator.
+     * \param seed Current state
+     * \return Next state
+     */
+    static int next_seed(int seed);
+
+    /**
+     * \brief Returns the amount of random numbers that are drawn to place the warriors of one round.
+     * Fights with more than two warriors draw a varying amount.
+     */
+    uint32_t draws_per_round() const;
+
+    /**
+     * \brief Sets up and fights the next round and adds its outcome to the results.
+     */
+    void run_round();
+
 
     /**
      * \brief Inserts a warrior into the core at the given position.
@@ -77,17 +271,39 @@ private:
      */
     void insert_warriors();
 
+    /**
+     * \brief Dequeues the next task of a warrior and executes it.
+     * \param ri Warrior index
+     */
+    template <exec_engine ENGINE>
+    force_inline void execute_task(uint32_t ri);
+
+    /**
+     * \brief Runs a round between exactly two warriors. The queues are executed alternately until one of them is empty,
+     * which gives the same result as calling step() until at most one warrior is alive.
+     * \return Count of alive warriors
+     */
+    template <exec_engine ENGINE>
+    uint32_t run_duel();
+
 public:
-    uint32_t core_size      = 8000;
+    /**
+     * \brief The biggest core size that fits into the fields of the core cells.
+     */
+    static constexpr uint64_t max_core_size = (uint64_t)std::numeric_limits<T>::max() + 1;
+
+    uint32_t core_size      = CORE_SIZE != 0 ? CORE_SIZE : 8000;
     uint32_t max_cycles     = 80000;
     uint32_t max_process    = 8000;
     uint32_t max_length     = 200;
     uint32_t min_separation = 200;
 
-    uint32_t read_limit     = 8000;
-    uint32_t write_limit    = 8000;
+    uint32_t read_limit     = CORE_SIZE != 0 ? READ_LIMIT : 8000;
+    uint32_t write_limit    = CORE_SIZE != 0 ? WRITE_LIMIT : 8000;
+
+    exec_engine engine      = exec_engine::table;
 
-    mmars(uint32_t core_size, uint32_t max_cycles, uint32_t max_process, uint32_t max_length, uint32_t min_separation)
+    basic_mmars(uint32_t core_size, uint32_t max_cycles, uint32_t max_process, uint32_t max_length, uint32_t min_separation)
         : core_size(core_size),
           max_cycles(max_cycles),
           max_process(max_process),
@@ -98,23 +314,37 @@ public:
         write_limit = core_size;
     }
 
-    mmars() = default;
+    basic_mmars() = default;
 
     /**
      * \brief Clears everything. This includes warriors.
      */
     void clear();
 
+    /**
+     * \brief Removes all warriors and their results, but keeps the memory of the core, the process queues and the warrior code.
+     * A following fight with the same settings doesn't allocate.
+     */
+    void remove_warriors();
+
     /**
      * \brief Adds a warrior to the mars.
+     * \return Slot of the warrior, used to query its results
+     */
+    size_t add_warrior(std::shared_ptr<warrior> w);
+
+    /**
+     * \brief Returns the fight results of the warrior in a slot
+     * \param slot Slot returned by add_warrior
+     * \return Results
      */
-    void add_warrior(std::shared_ptr<warrior> w);
+    result get_result(size_t slot) const;
 
     /**
-     * \brief Returns the fight results of a warrior
+     * \brief Returns the fight results of a warrior. If the warrior was added multiple times the results of all its slots are summed.
      * \return Results
      */
-    result get_result(std::shared_ptr<warrior> w);
+    result get_result(const std::shared_ptr<warrior>& w) const;
 
     /**
      * \brief Sets the seed of the random number generator.
@@ -139,6 +369,52 @@ public:
      */
     void run(int rounds);
 
+    /**
+     * \brief Runs the rounds [first_round, first_round + rounds) of a fight that starts with the current seed. The warriors
+     * are placed exactly like in these rounds of run(), so the results of all slices of a fight add up to the results of run().
+     * Only supported for fights with up to two warriors.
+     * \param first_round Index of the first round
+     * \param rounds Amount of rounds
+     */
+    void run_slice(int first_round, int rounds);
+
+    /**
+     * \brief Runs a fight with the rounds split across multiple threads. Results are identical to run().
+     * Fights with more than two warriors fall back to run().
+     * \param rounds Amount of rounds
+     * \param threads Amount of threads
+     */
+    void run_parallel(int rounds, int threads);
+
+    /**
+     * \brief Computes the state of the random number generator after a number of draws without drawing them one by one.
+     * \param seed Current state
+     * \param draws Amount of draws to skip
+     * \return The state after the draws
+     */
+    static int seed_after(int seed, uint64_t draws);
+
+    /**
+     * \brief Returns the amount of rounds of a position sweep. This is every legal position of the second warrior,
+     * from min_separation to core_size - min_separation, once with each warrior moving first.
+     * \return Rounds of a sweep
+     */
+    uint32_t sweep_rounds() const;
+
+    /**
+     * \brief Runs the rounds [first_round, first_round + rounds) of a position sweep. Round r places the second warrior at
+     * min_separation + r / 2 and lets warrior r % 2 move first. Results don't depend on the seed. Only supported for fights with two warriors.
+     * \param first_round Index of the first round
+     * \param rounds Amount of rounds
+     */
+    void run_sweep(uint32_t first_round, uint32_t rounds);
+
+    /**
+     * \brief Returns the amount of instructions that were executed since the mars was created.
+     * \return Executed instructions
+     */
+    uint64_t executed() const;
+
     /**
      * \brief Gets a instruction from the core.
      * \param i Index of the instruction
@@ -153,3 +429,135 @@ public:
      */
     std::vector<uint32_t> get_tasks(std::shared_ptr<warrior> w);
 };
+
+/**
+ * \brief A mars with 32 bit fields that supports any core size.
+ */
+typedef basic_mmars<uint32_t> mmars;
+
+/**
+ * \brief A mars with 16 bit fields for core sizes up to 65536. Keeps a 8000 cell core inside 48 KB.
+ */
+typedef basic_mmars<uint16_t> compact_mmars;
+
+/*
+ * Specializations for the core sizes of the common hills. Address folding uses constants instead of divisions.
+ * Each one instantiates the whole handler table, so builds that define MMARS_NO_HILLS leave them out and use the
+ * runtime sized mars for these core sizes instead.
+ */
+typedef basic_mmars<uint16_t, 8000>     mmars_8000;
+typedef basic_mmars<uint16_t, 800>      mmars_800;
+typedef basic_mmars<uint16_t, 8192>     mmars_8192;
+typedef basic_mmars<uint16_t, 55440>    mmars_55440;
+
+/**
+ * \brief Type tag that is passed to the callable of select_mmars.
+ */
+template <typename M>
+struct mmars_type
+{
+    typedef M type;
+};
+
+/**
+ * \brief Selects the fastest mars type that supports the given settings and passes it to func as mmars_type<M>.
+ * \return The return value of func
+ */
+template <typename F>
+auto select_mmars(uint32_t core_size, uint32_t read_limit, uint32_t write_limit, F&& func)
+{
+#ifndef MMARS_NO_HILLS
+    if (read_limit == core_size && write_limit == core_size)
+    {
+        switch (core_size)
+        {
+        case 8000: return func(mmars_type<mmars_8000>());
+        case 800: return func(mmars_type<mmars_800>());
+        case 8192: return func(mmars_type<mmars_8192>());
+        case 55440: return func(mmars_type<mmars_55440>());
+        default: ;
+        }
+    }
+#else
+    (void)read_limit;
+    (void)write_limit;
+#endif
+
+    if (core_size <= compact_mmars::max_core_size)
+        return func(mmars_type<compact_mmars>());
+
+    return func(mmars_type<mmars>());
+}
+
+/**
+ * \brief Creates the fastest mars that supports the given settings and passes it to func.
+ * \param read_limit Read limit (0 defaults to core size)
+ * \param write_limit Write limit (0 defaults to core size)
+ * \param func Callable that accepts any mars type, e.g. a generic lambda taking auto&
+ * \return The return value of func
+ */
+template <typename F>
+auto with_mmars(uint32_t core_size, uint32_t max_cycles, uint32_t max_process, uint32_t max_length, uint32_t min_separation,
+    uint32_t read_limit, uint32_t write_limit, F&& func)
+{
+    if (read_limit == 0) read_limit = core_size;
+    if (write_limit == 0) write_limit = core_size;
+
+    return select_mmars(core_size, read_limit, write_limit, [&](auto type)
+    {
+        typename decltype(type)::type m(core_size, max_cycles, max_process, max_length, min_separation);
+        m.read_limit = read_limit;
+        m.write_limit = write_limit;
+        return func(m);
+    });
+}
+
+/**
+ * \brief Returns the mars of type M that is owned by the calling thread.
+ */
+template <typename M>
+M& thread_mmars()
+{
+    static thread_local M m;
+    return m;
+}
+
+/**
+ * \brief Like with_mmars, but passes a mars that is owned by the calling thread. Every call on the same thread with the same
+ * mars type gets the same instance back with its warriors removed, so the core and process queues aren't allocated again.
+ * \param read_limit Read limit (0 defaults to core size)
+ * \param write_limit Write limit (0 defaults to core size)
+ * \param engine The engine the mars executes instructions with
+ * \param func Callable that accepts any mars type, e.g. a generic lambda taking auto&
+ * \return The return value of func
+ */
+template <typename F>
+auto with_thread_mmars(uint32_t core_size, uint32_t max_cycles, uint32_t max_process, uint32_t max_length, uint32_t min_separation,
+    uint32_t read_limit, uint32_t write_limit, exec_engine engine, F&& func)
+{
+    if (read_limit == 0) read_limit = core_size;
+    if (write_limit == 0) write_limit = core_size;
+
+    return select_mmars(core_size, read_limit, write_limit, [&](auto type)
+    {
+        auto& m = thread_mmars<typename decltype(type)::type>();
+        m.remove_warriors();
+        m.core_size = core_size;
+        m.max_cycles = max_cycles;
+        m.max_process = max_process;
+        m.max_length = max_length;
+        m.min_separation = min_separation;
+        m.read_limit = read_limit;
+        m.write_limit = write_limit;
+        m.engine = engine;
+
+        // Drop the references to the warriors once func is done
+        struct release
+        {
+            decltype(m)& mars;
+            ~release() { mars.remove_warriors(); }
+        } guard{ m };
+
+        return func(m);
+    });
+}
@@ -0,0 +1,11 @@
+#include "mmars_impl.hpp"
+
+/*
+ * Mars specializations for the core sizes of the common hills. Left out if MMARS_NO_HILLS is defined.
+ */
+#ifndef MMARS_NO_HILLS
+template class basic_mmars<uint16_t, 8000>;
+template class basic_mmars<uint16_t, 800>;
+template class basic_mmars<uint16_t, 8192>;
+template class basic_mmars<uint16_t, 55440>;
+#endif
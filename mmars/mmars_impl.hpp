@@ -0,0 +1,1277 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+#include "mmars.hpp"
+
+#define arith(op) \
+       switch (ir.mod()) { \
+       case modifier::a: \
+          write((pc + wpb) % size()).a = \
+             ((wide)irb.a op ira.a) % size() \
+          ; \
+          break; \
+       case modifier::b: \
+          write((pc + wpb) % size()).b = \
+             ((wide)irb.b op ira.b) % size() \
+          ; \
+          break; \
+       case modifier::ab: \
+          write((pc + wpb) % size()).b = \
+             ((wide)irb.b op ira.a) % size() \
+          ; \
+          break; \
+       case modifier::ba: \
+          write((pc + wpb) % size()).a = \
+             ((wide)irb.b op ira.a) % size() \
+          ; \
+          break; \
+       case modifier::f: \
+       case modifier::i: \
+          write((pc + wpb) % size()).a = \
+             ((wide)irb.a op ira.a) % size() \
+          ; \
+          write((pc + wpb) % size()).b = \
+             ((wide)irb.b op ira.b) % size() \
+          ; \
+          break; \
+       case modifier::x: \
+          write((pc + wpb) % size()).b = \
+             ((wide)irb.a op ira.b) % size() \
+          ; \
+          write((pc + wpb) % size()).a = \
+             ((wide)irb.b op ira.a) % size() \
+          ; \
+          break; \
+       default: \
+          throw std::runtime_error("unsupported operation"); \
+       }; \
+       queue(ri, (pc + 1) % size()); \
+       break;
+
+#define arith_div(op) \
+       switch (ir.mod()) { \
+       case modifier::a: \
+          if (ira.a != 0) \
+             write((pc + wpb) % size()).a = irb.a op ira.a; \
+          else do_queue = false; \
+          break; \
+       case modifier::b: \
+          if (ira.b != 0) \
+             write((pc + wpb) % size()).b = irb.b op ira.b; \
+          else do_queue = false; \
+          break; \
+       case modifier::ab: \
+          if (ira.a != 0) \
+             write((pc + wpb) % size()).b = irb.b op ira.a; \
+          else do_queue = false; \
+          break; \
+       case modifier::ba: \
+          if (ira.b != 0) \
+             write((pc + wpb) % size()).a = irb.a op ira.b; \
+          else do_queue = false; \
+          break; \
+       case modifier::f: \
+       case modifier::i: \
+          if (ira.a != 0) \
+             write((pc + wpb) % size()).a = irb.a op ira.a; \
+          if (ira.b != 0) \
+             write((pc + wpb) % size()).b = irb.b op ira.b; \
+          if ((ira.a == 0) || (ira.b == 0)) \
+             do_queue = false; \
+          break; \
+       case modifier::x: \
+          if (ira.a != 0) \
+             write((pc + wpb) % size()).b = irb.b op ira.a; \
+          if (ira.b != 0) \
+             write((pc + wpb) % size()).a = irb.a op ira.b; \
+          if ((ira.a == 0) || (ira.b == 0)) \
+             do_queue = false; \
+          break; \
+       default: \
+          throw std::runtime_error("unsupported operation"); \
+       }; \
+       if(do_queue) queue(ri, (pc + 1) % size()); \
+       break;
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+force_inline uint32_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::fold(uint32_t ptr, uint32_t limit) const
+{
+    uint32_t res = limit == size() ? wrap(ptr) : ptr % limit;
+    if(res > (limit / 2)) res += size() - limit;
+    return res;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+inline void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::queue(int wi, uint32_t ptr)
+{
+    _tasks.enqueue(wi, ptr);
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+inline int basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::random()
+{
+    _seed = next_seed(_seed);
+    return _seed;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+inline int basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::next_seed(int seed)
+{
+    seed = 16807 * (seed % 127773) - 2836 * (seed / 127773);
+    if (seed < 0)
+        seed += 2147483647;
+    return seed;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+int basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::seed_after(int seed, uint64_t draws)
+{
+    const uint64_t modulus = 2147483647;
+    if (draws == 0) return seed;
+
+    // next_seed is seed * 16807 mod (2^31 - 1) for states inside [0, 2^31 - 1). Other states get there with one draw.
+    if ((seed < 0 || (uint64_t)seed >= modulus) && draws > 0)
+    {
+        seed = next_seed(seed);
+        draws--;
+    }
+
+    uint64_t factor = 1;
+    uint64_t base = 16807;
+    for (; draws > 0; draws >>= 1)
+    {
+        if (draws & 1) factor = factor * base % modulus;
+        base = base * base % modulus;
+    }
+
+    return (int)((uint64_t)seed * factor % modulus);
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+uint32_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::draws_per_round() const
+{
+    if (_warriors.size() > 2) throw std::runtime_error("fights with more than two warriors draw a varying amount of random numbers per round");
+    return _warriors.size() == 2 ? 1 : 0;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+uint32_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::copy_warrior(int wi, uint32_t p)
+{
+    auto& code = _code[wi];
+    std::memcpy(&_core[p], code.data(), code.size() * sizeof(cell));
+    for (uint32_t b = p >> dirty_block_shift; b <= (p + (uint32_t)code.size() - 1) >> dirty_block_shift; ++b)
+    {
+        mark_dirty(b);
+    }
+    _tasks.enqueue(wi, p + _warriors[wi]->start);
+    return p + (uint32_t)code.size();
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::insert_warriors()
+{
+    std::vector<uint32_t> target_positions = std::vector<uint32_t>(_warriors.size());
+
+    if (_warriors.size() == 2 && _sweep) {
+        target_positions[1] = _sweep_position;
+    }
+    else if (_warriors.size() == 2) {
+        target_positions[1] = min_separation + _seed % (size() + 1 - (uint32_t)_warriors.size() * min_separation);
+        random();
+    }
+    else if(_warriors.size() > 2)
+    {
+        bool failed = false;
+        uint32_t pos = 1;
+        int retries = 20;
+        int retries_backtrack = 4;
+
+        do
+        {
+            target_positions[pos] = random() % (size() - 2 * min_separation + 1) + min_separation;
+
+            uint32_t i;
+            for (i = 1; i < pos; ++i)
+            {
+                uint32_t diff = (uint32_t)std::abs((int32_t)target_positions[pos] - (int32_t)target_positions[i]);
+                if (diff < min_separation)
+                    break;
+            }
+
+            if (i == pos)
+            {
+                ++pos;
+            }
+            else
+            {
+                if (!retries_backtrack) failed = true;
+                if (!retries)
+                {
+                    pos = i;
+                    --retries_backtrack;
+                    retries = 20;
+                }
+                else
+                {
+                    --retries;
+                }
+            }
+        } while (pos < _warriors.size() && !failed);
+
+        if(failed)
+        {
+            // TODO: implement backup strategy
+            throw std::runtime_error("couldn't position warriors");
+        }
+    }
+
+    for (uint32_t i = 0; i < _warriors.size(); ++i)
+    {
+        copy_warrior(i, target_positions[i]);
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::clear()
+{
+    _warriors.clear();
+    _code.clear();
+    _results.clear();
+    _tasks = task_queues();
+    _core.clear();
+    _dirty.clear();
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::remove_warriors()
+{
+    // The core stays dirty, so the next setup() resets the cells of the last fight
+    _warriors.clear();
+    _results.clear();
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+size_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::add_warrior(std::shared_ptr<warrior> w)
+{
+    if (w->code.empty()) throw std::runtime_error("warrior has no code");
+    if (w->code.size() > max_length) throw std::runtime_error("warrior code is too long");
+
+    size_t slot = _warriors.size();
+    _warriors.push_back(std::move(w));
+    _results.emplace_back();
+
+    // Code buffers of removed warriors are reused
+    if (_code.size() <= slot) _code.emplace_back();
+    _code[slot].clear();
+    for (auto && ins : _warriors.back()->code)
+    {
+        _code[slot].emplace_back(ins);
+    }
+
+    return slot;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+result basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::get_result(size_t slot) const
+{
+    if (slot >= _results.size())
+    {
+        throw std::runtime_error("warrior is not part of the mars");
+    }
+
+    return _results[slot];
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+result basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::get_result(const std::shared_ptr<warrior>& w) const
+{
+    bool found = false;
+    result res;
+    for (size_t i = 0; i < _warriors.size(); ++i)
+    {
+        if (_warriors[i] != w) continue;
+
+        found = true;
+        res += _results[i];
+    }
+
+    if (!found)
+    {
+        throw std::runtime_error("warrior is not part of the mars");
+    }
+
+    return res;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::set_seed(uint32_t seed)
+{
+    _seed = seed;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::setup()
+{
+    if (core_size > max_core_size) throw std::runtime_error("core size is too large for the field type of this mars");
+    if constexpr (CORE_SIZE != 0)
+    {
+        if (core_size != CORE_SIZE || read_limit != READ_LIMIT || write_limit != WRITE_LIMIT)
+            throw std::runtime_error("core size or limits don't match the specialization of this mars");
+    }
+
+    if (_core.capacity() != size() || _core.size() != size())
+    {
+        _core = std::vector<cell>(size(), cell());
+        _dirty = std::vector<uint64_t>((((size() + dirty_block_size - 1) >> dirty_block_shift) + 63) / 64, 0);
+    }
+    else
+    {
+        // Only the blocks that were written during the last round have to be reset
+        for (uint32_t w = 0; w < _dirty.size(); ++w)
+        {
+            uint64_t bits = _dirty[w];
+            for (uint32_t b = w * 64; bits != 0; ++b, bits >>= 1)
+            {
+                if (!(bits & 1)) continue;
+
+                uint32_t begin = b << dirty_block_shift;
+                std::fill(_core.begin() + begin, _core.begin() + std::min(begin + dirty_block_size, size()), cell());
+            }
+            _dirty[w] = 0;
+        }
+    }
+
+    if (_tasks.size() != _warriors.size() || _tasks.limit() != max_process)
+    {
+        _tasks = task_queues((uint32_t)_warriors.size(), max_process);
+    }
+    else
+    {
+        _tasks.clear();
+    }
+
+    insert_warriors();
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::interpret(uint32_t ri, uint32_t pc)
+{
+    uint32_t rpa, wpa, rpb, wpb, pip;
+    cell ir = _core[pc];
+
+    /*
+     * Process A-Mode
+     */
+    if(ir.a_mode() == im)
+    {
+        rpa = wpa = 0;
+    }
+    else
+    {
+        rpa = fold(ir.a, rlimit());
+        wpa = fold(ir.a, wlimit());
+
+        if (ir.a_mode() != dir) {
+            if(ir.a_mode() == pre_dec_a)
+            {
+                write((pc + wpa) % size()).a = (_core[(pc + wpa) % size()].a + size() - 1) % size();
+            }
+            else if (ir.a_mode() == pre_dec_b)
+            {
+                write((pc + wpa) % size()).b = (_core[(pc + wpa) % size()].b + size() - 1) % size();;
+            }
+            else if(ir.a_mode() == post_inc_a || ir.a_mode() == post_inc_b)
+            {
+                pip = (pc + wpa) % size();
+            }
+
+            if(ir.a_mode() == pre_dec_a || ir.a_mode() == post_inc_a || ir.a_mode() == ind_a)
+            {
+                rpa = fold(rpa + _core[(pc + rpa) % size()].a, rlimit());
+                wpa = fold(wpa + _core[(pc + wpa) % size()].a, wlimit());
+            }
+            else
+            {
+                rpa = fold(rpa + _core[(pc + rpa) % size()].b, rlimit());
+                wpa = fold(wpa + _core[(pc + wpa) % size()].b, wlimit());
+            }
+        }
+    }
+
+    cell ira = _core[(pc + rpa) % size()];
+
+    /*
+     * Process A-Mode Post Increment
+     */
+    if(ir.a_mode() == post_inc_a)
+    {
+        write(pip).a = (_core[pip].a + 1) % size();
+    }
+    else if(ir.a_mode() == post_inc_b)
+    {
+        write(pip).b = (_core[pip].b + 1) % size();
+    }
+
+    /*
+     * Process B-Mode
+     */
+    if(ir.b_mode() == im)
+    {
+        rpb = wpb = 0;
+    } 
+    else
+    {
+        rpb = fold(ir.b, rlimit());
+        wpb = fold(ir.b, wlimit());
+
+        if(ir.b_mode() != dir)
+        {
+            if(ir.b_mode() == pre_dec_a)
+            {
+                write((pc + wpb) % size()).a = (_core[(pc + wpb) % size()].a + size() - 1) % size();
+            }
+            else if (ir.b_mode() == pre_dec_b)
+            {
+                write((pc + wpb) % size()).b = (_core[(pc + wpb) % size()].b + size() - 1) % size();;
+            }
+            else if(ir.b_mode() == post_inc_a || ir.b_mode() == post_inc_b)
+            {
+                pip = (pc + wpb) % size();
+            }
+
+            if (ir.b_mode() == pre_dec_a || ir.b_mode() == post_inc_a || ir.b_mode() == ind_a)
+            {
+                rpb = fold(rpb + _core[(pc + rpb) % size()].a, rlimit());
+                wpb = fold(wpb + _core[(pc + wpb) % size()].a, wlimit());
+            }
+            else
+            {
+                rpb = fold(rpb + _core[(pc + rpb) % size()].b, rlimit());
+                wpb = fold(wpb + _core[(pc + wpb) % size()].b, wlimit());
+            }
+        }
+    }
+
+    cell irb = _core[(pc + rpb) % size()];
+
+    /*
+     * Process B-Mode Post Increment
+     */
+    if (ir.b_mode() == post_inc_a)
+    {
+        write(pip).a = (_core[pip].a + 1) % size();
+    }
+    else if (ir.b_mode() == post_inc_b)
+    {
+        write(pip).b = (_core[pip].b + 1) % size();
+    }
+
+    /*
+     * Process Instruction
+     */
+    bool do_queue = true;
+    switch (ir.op())
+    {
+    case op_code::nop:
+        queue(ri, (pc + 1) % size());
+        break;
+    case op_code::dat:
+        break;
+    case op_code::mov:
+        switch (ir.mod())
+        {
+        case modifier::a:
+            write((pc + wpb) % size()).a = ira.a;
+            break;
+        case modifier::b:
+            write((pc + wpb) % size()).b = ira.b;
+            break;
+        case modifier::ab:
+            write((pc + wpb) % size()).b = ira.a;
+            break;
+        case modifier::ba:
+            write((pc + wpb) % size()).a = ira.b;
+            break;
+        case modifier::f:
+            write((pc + wpb) % size()).a = ira.a;
+            write((pc + wpb) % size()).b = ira.b;
+            break;
+        case modifier::x:
+            write((pc + wpb) % size()).b = ira.a;
+            write((pc + wpb) % size()).a = ira.b;
+            break;
+        case modifier::i:
+            write((pc + wpb) % size()) = ira;
+            break;
+        default: 
+            throw std::runtime_error("unsupported operation");
+        }
+        queue(ri, (pc + 1) % size());
+        break;
+    case op_code::spl:
+        _tasks.enqueue(ri, (pc + 1) % size(), (pc + rpa) % size());
+        break;
+    case op_code::jmp:
+        queue(ri, (pc + rpa) % size());
+        break;
+    case op_code::add: arith(+)
+    case op_code::sub: arith(+ size() -)
+    case op_code::mul: arith(*)
+    case op_code::div: arith_div(/)
+    case op_code::mod: arith_div(%)
+    case op_code::jmz:
+        switch (ir.mod())
+        {
+        case modifier::a:
+        case modifier::ba:
+            if(irb.a == 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::b:
+        case modifier::ab:
+            if (irb.b == 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::f:
+        case modifier::x:
+        case modifier::i:
+            if (irb.b == 0 && irb.a == 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        default:
+            throw std::runtime_error("unsupported operation");
+        }
+        break;
+    case op_code::jmn:
+        switch (ir.mod())
+        {
+        case modifier::a:
+        case modifier::ba:
+            if (irb.a != 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::b:
+        case modifier::ab:
+            if (irb.b != 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::f:
+        case modifier::x:
+        case modifier::i:
+            if (irb.b != 0 || irb.a != 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        default:
+            throw std::runtime_error("unsupported operation");
+        }
+        break;
+    case op_code::djn:
+        switch (ir.mod())
+        {
+        case modifier::a:
+        case modifier::ba:
+            write((pc + wpb) % size()).a = (_core[(pc + wpb) % size()].a + size() - 1) % size();
+            irb.a -= 1;
+
+            if(irb.a != 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::b:
+        case modifier::ab:
+            write((pc + wpb) % size()).b = (_core[(pc + wpb) % size()].b + size() - 1) % size();
+            irb.b -= 1;
+
+            if (irb.b != 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::f:
+        case modifier::x:
+        case modifier::i:
+            write((pc + wpb) % size()).a = (_core[(pc + wpb) % size()].a + size() - 1) % size();
+            irb.a -= 1;
+
+            write((pc + wpb) % size()).b = (_core[(pc + wpb) % size()].b + size() - 1) % size();
+            irb.b -= 1;
+
+            if (irb.b != 0 || irb.a != 0) queue(ri, (pc + rpa) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        default:
+            throw std::runtime_error("unsupported operation");
+        }
+        break;
+    case op_code::sne:
+        switch (ir.mod())
+        {
+        case modifier::a:
+            if (ira.a != irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::b:
+            if (ira.b != irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::ab:
+            if (ira.a != irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::ba:
+            if (ira.b != irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::f:
+            if (ira.b != irb.b || ira.a != irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::x:
+            if (ira.a != irb.b || ira.b != irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::i:
+            if (ira.a != irb.a ||
+                ira.b != irb.b ||
+                ira.code != irb.code) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        default:
+            throw std::runtime_error("unsupported operation");
+        }
+        break;
+    case op_code::cmp:
+        switch (ir.mod())
+        {
+        case modifier::a: 
+            if(ira.a == irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::b:
+            if (ira.b == irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::ab:
+            if (ira.a == irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::ba:
+            if (ira.b == irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::f:
+            if (ira.b == irb.b && ira.a == irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::x:
+            if (ira.a == irb.b && ira.b == irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::i:
+            if (ira.a == irb.a &&
+                ira.b == irb.b &&
+                ira.code == irb.code) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        default:
+            throw std::runtime_error("unsupported operation");
+        }
+        break;
+    case op_code::slt:
+        switch (ir.mod())
+        {
+        case modifier::a:
+            if (ira.a < irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::b:
+            if (ira.b < irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::ab:
+            if (ira.a < irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::ba:
+            if (ira.b < irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::f:
+        case modifier::i:
+            if (ira.a < irb.a &&
+                ira.b < irb.b) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        case modifier::x:
+            if (ira.a < irb.b &&
+                ira.b < irb.a) queue(ri, (pc + 2) % size());
+            else queue(ri, (pc + 1) % size());
+            break;
+        default:
+            throw std::runtime_error("unsupported operation");
+        }
+        break;
+    default: ;
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+inline size_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::handler_index(const cell& ir)
+{
+    return ir.code;
+}
+
+/**
+ * \brief Maps modifiers that behave the same for a opcode to one representative, so that equal handlers are only instantiated once.
+ */
+static constexpr modifier handler_modifier(op_code op, modifier mod)
+{
+    // Codes with a modifier above x can't be produced and only exist to fill the table
+    if (mod > modifier::x) return modifier::f;
+
+    switch (op)
+    {
+    case op_code::dat:
+    case op_code::nop:
+    case op_code::spl:
+    case op_code::jmp:
+        return modifier::b;
+    case op_code::jmz:
+    case op_code::jmn:
+    case op_code::djn:
+        if (mod == modifier::ba) return modifier::a;
+        if (mod == modifier::ab) return modifier::b;
+        if (mod == modifier::x || mod == modifier::i) return modifier::f;
+        return mod;
+    case op_code::add:
+    case op_code::sub:
+    case op_code::mul:
+    case op_code::div:
+    case op_code::mod:
+    case op_code::slt:
+        return mod == modifier::i ? modifier::f : mod;
+    default:
+        return mod;
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <size_t... I>
+constexpr std::array<typename basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::op_handler, sizeof...(I)> basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::make_handlers(std::index_sequence<I...>)
+{
+    return { &basic_mmars::handle<
+        (op_code)(I >> 9),
+        handler_modifier((op_code)(I >> 9), (modifier)(I >> 6 & 7)),
+        (addr_mode)(I >> 3 & 7),
+        (addr_mode)(I & 7)>... };
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+const std::array<typename basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::op_handler, basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::handler_count> basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::_handlers = make_handlers(std::make_index_sequence<handler_count>());
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <op_code OP, modifier MOD, addr_mode A_MODE, addr_mode B_MODE>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::handle(basic_mmars& m, uint32_t ri, uint32_t pc)
+{
+    // The b field has to be read before the a-mode can modify the instruction
+    uint32_t a = m._core[pc].a;
+    uint32_t b = m._core[pc].b;
+
+    uint32_t rpa, wpa, rpb, wpb;
+    cell ira = m.template operand<A_MODE>(pc, a, rpa, wpa);
+    cell irb = m.template operand<B_MODE>(pc, b, rpb, wpb);
+
+    m.template execute<OP, MOD>(ri, pc, ira, irb, rpa, wpb);
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <addr_mode MODE>
+force_inline basic_instruction<T> basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::operand(uint32_t pc, uint32_t field, uint32_t& rp, uint32_t& wp)
+{
+    if constexpr (MODE == im)
+    {
+        rp = wp = 0;
+        return _core[pc];
+    }
+    else if constexpr (MODE == dir)
+    {
+        rp = fold(field, rlimit());
+        wp = fold(field, wlimit());
+        return _core[wrap(pc + rp)];
+    }
+    else
+    {
+        rp = fold(field, rlimit());
+        wp = fold(field, wlimit());
+
+        // Only the pre-decrement and post-increment modes write to the core
+        constexpr bool modifies = MODE == pre_dec_a || MODE == pre_dec_b || MODE == post_inc_a || MODE == post_inc_b;
+        cell& ptr = modifies ? write(wrap(pc + wp)) : _core[wrap(pc + wp)];
+
+        if constexpr (MODE == pre_dec_a) ptr.a = dec(ptr.a);
+        else if constexpr (MODE == pre_dec_b) ptr.b = dec(ptr.b);
+
+        if constexpr (MODE == pre_dec_a || MODE == post_inc_a || MODE == ind_a)
+        {
+            rp = fold(rp + _core[wrap(pc + rp)].a, rlimit());
+            wp = fold(wp + ptr.a, wlimit());
+        }
+        else
+        {
+            rp = fold(rp + _core[wrap(pc + rp)].b, rlimit());
+            wp = fold(wp + ptr.b, wlimit());
+        }
+
+        cell res = _core[wrap(pc + rp)];
+
+        if constexpr (MODE == post_inc_a) ptr.a = inc(ptr.a);
+        else if constexpr (MODE == post_inc_b) ptr.b = inc(ptr.b);
+
+        return res;
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <modifier MOD, typename F>
+force_inline void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::execute_arith(uint32_t ri, uint32_t pc, const cell& ira, const cell& irb, uint32_t wpb, F op)
+{
+    cell& target = write(wrap(pc + wpb));
+
+    if constexpr (MOD == modifier::a) target.a = op(irb.a, ira.a);
+    else if constexpr (MOD == modifier::b) target.b = op(irb.b, ira.b);
+    else if constexpr (MOD == modifier::ab) target.b = op(irb.b, ira.a);
+    else if constexpr (MOD == modifier::ba) target.a = op(irb.b, ira.a);
+    else if constexpr (MOD == modifier::f || MOD == modifier::i)
+    {
+        target.a = op(irb.a, ira.a);
+        target.b = op(irb.b, ira.b);
+    }
+    else if constexpr (MOD == modifier::x)
+    {
+        target.b = op(irb.a, ira.b);
+        target.a = op(irb.b, ira.a);
+    }
+
+    queue(ri, wrap(pc + 1));
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <modifier MOD, typename F>
+force_inline void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::execute_div(uint32_t ri, uint32_t pc, const cell& ira, const cell& irb, uint32_t wpb, F op)
+{
+    cell& target = write(wrap(pc + wpb));
+
+    if constexpr (MOD == modifier::a)
+    {
+        if (ira.a == 0) return;
+        target.a = op(irb.a, ira.a);
+    }
+    else if constexpr (MOD == modifier::b)
+    {
+        if (ira.b == 0) return;
+        target.b = op(irb.b, ira.b);
+    }
+    else if constexpr (MOD == modifier::ab)
+    {
+        if (ira.a == 0) return;
+        target.b = op(irb.b, ira.a);
+    }
+    else if constexpr (MOD == modifier::ba)
+    {
+        if (ira.b == 0) return;
+        target.a = op(irb.a, ira.b);
+    }
+    else if constexpr (MOD == modifier::f || MOD == modifier::i)
+    {
+        if (ira.a != 0) target.a = op(irb.a, ira.a);
+        if (ira.b != 0) target.b = op(irb.b, ira.b);
+        if (ira.a == 0 || ira.b == 0) return;
+    }
+    else if constexpr (MOD == modifier::x)
+    {
+        if (ira.a != 0) target.b = op(irb.b, ira.a);
+        if (ira.b != 0) target.a = op(irb.a, ira.b);
+        if (ira.a == 0 || ira.b == 0) return;
+    }
+
+    queue(ri, wrap(pc + 1));
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <op_code OP, modifier MOD>
+force_inline void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::execute(uint32_t ri, uint32_t pc, const cell& ira, cell irb, uint32_t rpa, uint32_t wpb)
+{
+    if constexpr (OP == op_code::dat)
+    {
+    }
+    else if constexpr (OP == op_code::nop)
+    {
+        queue(ri, wrap(pc + 1));
+    }
+    else if constexpr (OP == op_code::mov)
+    {
+        cell& target = write(wrap(pc + wpb));
+
+        if constexpr (MOD == modifier::a) target.a = ira.a;
+        else if constexpr (MOD == modifier::b) target.b = ira.b;
+        else if constexpr (MOD == modifier::ab) target.b = ira.a;
+        else if constexpr (MOD == modifier::ba) target.a = ira.b;
+        else if constexpr (MOD == modifier::f)
+        {
+            target.a = ira.a;
+            target.b = ira.b;
+        }
+        else if constexpr (MOD == modifier::x)
+        {
+            target.b = ira.a;
+            target.a = ira.b;
+        }
+        else if constexpr (MOD == modifier::i) target = ira;
+
+        queue(ri, wrap(pc + 1));
+    }
+    else if constexpr (OP == op_code::spl)
+    {
+        _tasks.enqueue(ri, wrap(pc + 1), wrap(pc + rpa));
+    }
+    else if constexpr (OP == op_code::jmp)
+    {
+        queue(ri, wrap(pc + rpa));
+    }
+    else if constexpr (OP == op_code::add)
+    {
+        execute_arith<MOD>(ri, pc, ira, irb, wpb, [this](uint32_t b, uint32_t a) { return wrap(b + a); });
+    }
+    else if constexpr (OP == op_code::sub)
+    {
+        execute_arith<MOD>(ri, pc, ira, irb, wpb, [this](uint32_t b, uint32_t a) { return wrap(b + size() - a); });
+    }
+    else if constexpr (OP == op_code::mul)
+    {
+        execute_arith<MOD>(ri, pc, ira, irb, wpb, [this](uint32_t b, uint32_t a) { return (uint32_t)((wide)b * a % size()); });
+    }
+    else if constexpr (OP == op_code::div)
+    {
+        execute_div<MOD>(ri, pc, ira, irb, wpb, [](uint32_t b, uint32_t a) { return b / a; });
+    }
+    else if constexpr (OP == op_code::mod)
+    {
+        execute_div<MOD>(ri, pc, ira, irb, wpb, [](uint32_t b, uint32_t a) { return b % a; });
+    }
+    else if constexpr (OP == op_code::jmz)
+    {
+        bool zero;
+        if constexpr (MOD == modifier::a || MOD == modifier::ba) zero = irb.a == 0;
+        else if constexpr (MOD == modifier::b || MOD == modifier::ab) zero = irb.b == 0;
+        else zero = irb.a == 0 && irb.b == 0;
+
+        queue(ri, wrap(pc + (zero ? rpa : 1)));
+    }
+    else if constexpr (OP == op_code::jmn)
+    {
+        bool non_zero;
+        if constexpr (MOD == modifier::a || MOD == modifier::ba) non_zero = irb.a != 0;
+        else if constexpr (MOD == modifier::b || MOD == modifier::ab) non_zero = irb.b != 0;
+        else non_zero = irb.a != 0 || irb.b != 0;
+
+        queue(ri, wrap(pc + (non_zero ? rpa : 1)));
+    }
+    else if constexpr (OP == op_code::djn)
+    {
+        cell& target = write(wrap(pc + wpb));
+
+        if constexpr (MOD != modifier::b && MOD != modifier::ab)
+        {
+            target.a = dec(target.a);
+            irb.a -= 1;
+        }
+        if constexpr (MOD != modifier::a && MOD != modifier::ba)
+        {
+            target.b = dec(target.b);
+            irb.b -= 1;
+        }
+
+        bool non_zero;
+        if constexpr (MOD == modifier::a || MOD == modifier::ba) non_zero = irb.a != 0;
+        else if constexpr (MOD == modifier::b || MOD == modifier::ab) non_zero = irb.b != 0;
+        else non_zero = irb.a != 0 || irb.b != 0;
+
+        queue(ri, wrap(pc + (non_zero ? rpa : 1)));
+    }
+    else if constexpr (OP == op_code::cmp || OP == op_code::sne)
+    {
+        bool equal;
+        if constexpr (MOD == modifier::a) equal = ira.a == irb.a;
+        else if constexpr (MOD == modifier::b) equal = ira.b == irb.b;
+        else if constexpr (MOD == modifier::ab) equal = ira.a == irb.b;
+        else if constexpr (MOD == modifier::ba) equal = ira.b == irb.a;
+        else if constexpr (MOD == modifier::f) equal = ira.a == irb.a && ira.b == irb.b;
+        else if constexpr (MOD == modifier::x) equal = ira.a == irb.b && ira.b == irb.a;
+        else equal = ira.a == irb.a &&
+                     ira.b == irb.b &&
+                     ira.code == irb.code;
+
+        queue(ri, wrap(pc + (equal == (OP == op_code::cmp) ? 2 : 1)));
+    }
+    else if constexpr (OP == op_code::slt)
+    {
+        bool less;
+        if constexpr (MOD == modifier::a) less = ira.a < irb.a;
+        else if constexpr (MOD == modifier::b) less = ira.b < irb.b;
+        else if constexpr (MOD == modifier::ab) less = ira.a < irb.b;
+        else if constexpr (MOD == modifier::ba) less = ira.b < irb.a;
+        else if constexpr (MOD == modifier::f || MOD == modifier::i) less = ira.a < irb.a && ira.b < irb.b;
+        else less = ira.a < irb.b && ira.b < irb.a;
+
+        queue(ri, wrap(pc + (less ? 2 : 1)));
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <exec_engine ENGINE>
+force_inline void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::execute_task(uint32_t ri)
+{
+    /*
+     * Get Current Task
+     */
+    uint32_t pc = _tasks.dequeue(ri);
+
+    /*
+     * Execute Instruction
+     */
+    if constexpr (ENGINE == exec_engine::table) _handlers[handler_index(_core[pc])](*this, ri, pc);
+    else interpret(ri, pc);
+    _executed++;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+template <exec_engine ENGINE>
+uint32_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::run_duel()
+{
+    uint32_t first = _round % 2;
+    uint32_t second = first ^ 1;
+
+    for (uint32_t c = 0; c < max_cycles; ++c)
+    {
+        // The second warrior still gets its turn in the cycle the first one dies, like in step()
+        execute_task<ENGINE>(first);
+        bool first_alive = !_tasks.empty(first);
+
+        execute_task<ENGINE>(second);
+        bool second_alive = !_tasks.empty(second);
+
+        if (!first_alive || !second_alive) return (uint32_t)first_alive + (uint32_t)second_alive;
+    }
+
+    return 2;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+uint32_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::step()
+{
+    uint32_t alive = 0;
+    for (uint32_t i = 0; i < _warriors.size(); ++i)
+    {
+        uint32_t ri = (i + _round) % (uint32_t)_warriors.size();
+        if (_tasks.empty(ri)) continue;
+
+        if (engine == exec_engine::table) execute_task<exec_engine::table>(ri);
+        else execute_task<exec_engine::interpreter>(ri);
+
+        if (!_tasks.empty(ri)) alive++;
+    }
+
+    return alive;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::run_round()
+{
+    setup();
+
+    uint32_t alive = 0;
+    if (_warriors.size() == 2)
+    {
+        if (engine == exec_engine::table) alive = run_duel<exec_engine::table>();
+        else alive = run_duel<exec_engine::interpreter>();
+    }
+    else
+    {
+        for (uint32_t c = 0; c < max_cycles; ++c)
+        {
+            alive = step();
+            if (alive <= 1)
+                break;
+        }
+    }
+
+    for (uint32_t i = 0; i < _warriors.size(); ++i)
+    {
+        bool survived = !_tasks.empty(i);
+
+        if (survived && alive == 1 && _warriors.size() > 1) _results[i].win++;
+        else if (!survived) _results[i].loss++;
+        else _results[i].tie++;
+    }
+
+    _round++;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::run(int rounds)
+{
+    _round = 0;
+
+    _results.assign(_warriors.size(), result());
+
+    for (int r = 0; r < rounds; ++r)
+    {
+        run_round();
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::run_slice(int first_round, int rounds)
+{
+    _seed = seed_after(_seed, (uint64_t)draws_per_round() * first_round);
+    _round = (uint16_t)first_round;
+
+    _results.assign(_warriors.size(), result());
+
+    for (int r = 0; r < rounds; ++r)
+    {
+        run_round();
+    }
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+uint32_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::sweep_rounds() const
+{
+    if (size() + 1 < 2 * min_separation) return 0;
+    return 2 * (size() + 1 - 2 * min_separation);
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::run_sweep(uint32_t first_round, uint32_t rounds)
+{
+    if (_warriors.size() != 2) throw std::runtime_error("position sweeps need exactly two warriors");
+    if (first_round + rounds > sweep_rounds()) throw std::runtime_error("round is outside of the position sweep");
+
+    _results.assign(_warriors.size(), result());
+
+    _sweep = true;
+    for (uint32_t r = first_round; r < first_round + rounds; ++r)
+    {
+        _round = (uint16_t)r;
+        _sweep_position = min_separation + r / 2;
+        run_round();
+    }
+    _sweep = false;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+void basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::run_parallel(int rounds, int threads)
+{
+    threads = std::min(threads, rounds);
+    if (threads <= 1 || _warriors.size() > 2)
+    {
+        run(rounds);
+        return;
+    }
+
+    /*
+     * Each slice runs on its own copy of the mars
+     */
+    std::vector<basic_mmars> slices(threads, *this);
+    std::vector<std::exception_ptr> errors(threads);
+    auto fight_slice = [&slices, &errors, rounds, threads](int i)
+    {
+        try
+        {
+            int first = (int)((int64_t)rounds * i / threads);
+            slices[i].run_slice(first, (int)((int64_t)rounds * (i + 1) / threads) - first);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    // Errors are only rethrown after all threads were joined, a joinable thread would terminate the process
+    std::vector<std::thread> workers;
+    try
+    {
+        for (int i = 1; i < threads; ++i)
+        {
+            workers.emplace_back(fight_slice, i);
+        }
+    }
+    catch (...)
+    {
+        errors[0] = std::current_exception();
+    }
+    if (!errors[0]) fight_slice(0);
+
+    for (auto && worker : workers)
+    {
+        worker.join();
+    }
+
+    for (auto && error : errors)
+    {
+        if (error) std::rethrow_exception(error);
+    }
+
+    /*
+     * Merge the slices. The core, queues and seed end up like after the last round of run().
+     */
+    _results.assign(_warriors.size(), result());
+    uint64_t executed = _executed;
+    for (auto && slice : slices)
+    {
+        for (size_t i = 0; i < _results.size(); ++i)
+        {
+            _results[i] += slice._results[i];
+        }
+        executed += slice._executed - _executed;
+    }
+    _executed = executed;
+
+    basic_mmars& last = slices.back();
+    _core.swap(last._core);
+    _dirty.swap(last._dirty);
+    std::swap(_tasks, last._tasks);
+    _seed = last._seed;
+    _round = last._round;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+uint64_t basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::executed() const
+{
+    return _executed;
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+instruction basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::get_instruction(uint32_t i)
+{
+    return instruction(_core[i % size()]);
+}
+
+template <typename T, uint32_t CORE_SIZE, uint32_t READ_LIMIT, uint32_t WRITE_LIMIT>
+std::vector<uint32_t> basic_mmars<T, CORE_SIZE, READ_LIMIT, WRITE_LIMIT>::get_tasks(std::shared_ptr<warrior> w)
+{
+    for (uint32_t i = 0; i < _warriors.size(); ++i)
+    {
+        if(_warriors[i] == w)
+        {
+            std::vector<uint32_t> res;
+            res.reserve(_tasks.count(i));
+            for (uint32_t j = 0; j < _tasks.count(i); ++j)
+            {
+                res.push_back(_tasks.peek(i, j));
+            }
+            return res;
+        }
+    }
+    throw std::runtime_error("warrior not found");
+}
@@ -1,150 +1,380 @@
 #include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
 #include <cctype>
-#include <regex>
+#include <cstring>
+#include <iterator>
 
 #include "parser.hpp"
 
-int shunting_yard::eval(std::vector<token> expression)
+/*
+ * Tables
+ */
+
+struct prec_operator
+{
+    std::string_view text;
+    int precedence;
+    bool right_associative;
+    shunting_yard::op code;
+};
+
+static constexpr prec_operator operator_table[] = {
+    {"*", 10, false, shunting_yard::op::mul},
+    {"/", 10, false, shunting_yard::op::div},
+    {"%", 10, false, shunting_yard::op::mod},
+    {"-", 9, false, shunting_yard::op::sub},
+    {"+", 8, false, shunting_yard::op::add},
+};
+
+static const prec_operator* find_operator(std::string_view text)
+{
+    for (auto && o : operator_table)
+    {
+        if (o.text == text) return &o;
+    }
+
+    return nullptr;
+}
+
+static constexpr std::pair<std::string_view, op_code> opcode_table[] = {
+    {"SUB", op_code::sub},
+    {"ADD", op_code::add},
+    {"CMP", op_code::cmp},
+    {"DAT", op_code::dat},
+    {"DIV", op_code::div},
+    {"DJN", op_code::djn},
+    {"JMN", op_code::jmn},
+    {"JMP", op_code::jmp},
+    {"JMZ", op_code::jmz},
+    {"MOD", op_code::mod},
+    {"MOV", op_code::mov},
+    {"SEQ", op_code::cmp},
+    {"NOP", op_code::nop},
+    {"SNE", op_code::sne},
+    {"SLT", op_code::slt},
+    {"MUL", op_code::mul},
+    {"SPL", op_code::spl},
+};
+
+static constexpr std::pair<std::string_view, modifier> modifier_table[] = {
+    {".X", modifier::x},
+    {".A", modifier::a},
+    {".B", modifier::b},
+    {".AB", modifier::ab},
+    {".BA", modifier::ba},
+    {".I", modifier::i},
+    {".F", modifier::f},
+};
+
+static constexpr std::pair<char, addr_mode> addr_mode_table[] = {
+    {'#', addr_mode::im},
+    {'$', addr_mode::dir},
+    {'@', addr_mode::ind_b},
+    {'<', addr_mode::pre_dec_b},
+    {'>', addr_mode::post_inc_b},
+    {'*', addr_mode::ind_a},
+    {'{', addr_mode::pre_dec_a},
+    {'}', addr_mode::post_inc_a},
+};
+
+static constexpr std::string_view preprocessor_table[] = { "EQU", "END", "ORG", "FOR", "ROF" };
+
+/**
+ * \brief Compares a word case insensitive with the uppercase spelling of a table entry.
+ */
+static bool equal_upper(std::string_view text, std::string_view word)
+{
+    if (text.size() != word.size()) return false;
+
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (std::toupper((unsigned char)text[i]) != word[i]) return false;
+    }
+
+    return true;
+}
+
+/**
+ * \brief Parses a number like std::atoi without requiring a terminated string.
+ */
+static int to_int(std::string_view text)
+{
+    char buffer[32];
+    if (text.size() >= sizeof(buffer)) return std::atoi(std::string(text).c_str());
+
+    std::memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = 0;
+    return std::atoi(buffer);
+}
+
+static op_code to_opcode(std::string_view text)
+{
+    for (auto && [name, op] : opcode_table)
+    {
+        if (name == text) return op;
+    }
+
+    return op_code();
+}
+
+static modifier to_modifier(std::string_view text)
+{
+    for (auto && [name, mod] : modifier_table)
+    {
+        if (name == text) return mod;
+    }
+
+    return modifier();
+}
+
+static addr_mode to_addr_mode(std::string_view text)
+{
+    for (auto && [c, mode] : addr_mode_table)
+    {
+        if (text.size() == 1 && text[0] == c) return mode;
+    }
+
+    return addr_mode();
+}
+
+/*
+ * Expressions
+ */
+
+shunting_yard::program shunting_yard::compile(const std::vector<token>& expression, const std::unordered_map<std::string_view, int>& labels) const
 {
-    if (expression.empty()) return 0;
+    program p;
+    if (expression.empty())
+    {
+        p.steps.push_back({ op::constant, 0 });
+        p.depth = 1;
+        return p;
+    }
+
+    // The operands keep their text until they are compiled, because unary minus is folded into the text like before.
+    struct operand
+    {
+        std::string text;
+        op code;
+    };
 
-    if (expression[0].text == "+")
+    std::vector<operand> items;
+    items.reserve(expression.size());
+    for (auto&& tok : expression)
     {
-        expression.erase(expression.begin(), expression.begin() + 1);
+        items.push_back({ std::string(tok.text), tok.type == token_type::label ? op::label : op::constant });
     }
 
-    if (expression[0].text == "-")
+    if (items[0].text == "+")
     {
-        expression.erase(expression.begin(), expression.begin() + 1);
-        expression[0].text = "-" + expression[0].text;
+        items.erase(items.begin(), items.begin() + 1);
     }
 
-    for (uint32_t i = 0; i < expression.size() - 1; ++i) // combine unary + / - into string
+    if (!items.empty() && items[0].text == "-")
     {
-        if (_operators.count(expression[i].text) && expression[i + 1].text == "+")
+        items.erase(items.begin(), items.begin() + 1);
+        if (items.empty()) throw std::runtime_error("expression evaluation failed");
+
+        if (items[0].code == op::label) items[0].code = op::label_neg;
+        else items[0].text = "-" + items[0].text;
+    }
+
+    if (items.empty()) throw std::runtime_error("expression evaluation failed");
+
+    for (size_t i = 0; i + 1 < items.size(); ++i) // combine unary + / - into the operand
+    {
+        if (find_operator(items[i].text) && items[i + 1].text == "+")
         {
-            expression.erase(expression.begin() + i + 1, expression.begin() + i + 2);
+            items.erase(items.begin() + i + 1, items.begin() + i + 2);
         }
-        else if (_operators.count(expression[i].text) && expression[i + 1].text == "-")
+        else if (find_operator(items[i].text) && items[i + 1].text == "-")
         {
-            expression.erase(expression.begin() + i + 1, expression.begin() + i + 2);
-            if (std::isdigit(expression[i + 1].text[0]))
-            {
-                expression[i + 1].text = "-" + expression[i + 1].text;
-            }
+            items.erase(items.begin() + i + 1, items.begin() + i + 2);
+            if (i + 1 >= items.size()) throw std::runtime_error("expression evaluation failed");
+
+            if (items[i + 1].code == op::label) items[i + 1].code = op::label_neg_op;
+            else if (std::isdigit(items[i + 1].text[0])) items[i + 1].text = "-" + items[i + 1].text;
         }
     }
 
-    std::stack<std::string> stack;
-    std::vector<std::string> postfix;
+    std::vector<std::string> stack;
+    std::vector<operand> postfix;
 
     auto pop_op_stack = [&]()
     {
-        std::string t = stack.top();
-        stack.pop();
+        std::string t = std::move(stack.back());
+        stack.pop_back();
         return t;
     };
 
-    for (auto&& tok : expression)
+    for (auto&& item : items)
     {
-        if (tok.text == "(")
+        if (item.code != op::constant)
         {
-            stack.push("(");
+            postfix.push_back(item);
         }
-        else if (tok.text == ")")
+        else if (item.text == "(")
+        {
+            stack.push_back("(");
+        }
+        else if (item.text == ")")
         {
             while (true)
             {
+                if (stack.empty()) throw std::runtime_error("expression evaluation failed");
+
                 auto op = pop_op_stack();
+                if (op == "(") break;
 
-                if (op == "(")
+                postfix.push_back({ op, op::constant });
+            }
+        }
+        else if (auto current = find_operator(item.text))
+        {
+            while (!stack.empty())
+            {
+                auto top = find_operator(stack.back());
+                if (!top ||
+                    current->precedence > top->precedence ||
+                    (current->precedence == top->precedence && current->right_associative))
                 {
                     break;
                 }
 
-                postfix.push_back(op);
+                postfix.push_back({ pop_op_stack(), op::constant });
             }
+
+            stack.push_back(item.text);
         }
         else
         {
-            if (_operators.count(tok.text))
-            {
-                while (!stack.empty())
-                {
-                    if (!_operators.count(stack.top()) ||
-                        _operators[tok.text].precedence > _operators[stack.top()].precedence ||
-                        (_operators[tok.text].precedence == _operators[stack.top()].precedence && _operators[tok.text].right_associative))
-                    {
-                        break;
-                    }
+            postfix.push_back(item);
+        }
+    }
 
-                    postfix.push_back(pop_op_stack());
-                }
+    while (!stack.empty())
+    {
+        postfix.push_back({ pop_op_stack(), op::constant });
+    }
 
-                stack.push(tok.text);
+    uint32_t depth = 0;
+    for (auto&& item : postfix)
+    {
+        auto found = item.code == op::constant ? find_operator(item.text) : nullptr;
+        if (found)
+        {
+            if (depth < 2) throw std::runtime_error("expression evaluation failed");
+
+            p.steps.push_back({ found->code, 0 });
+            depth--;
+        }
+        else
+        {
+            if (item.code == op::constant)
+            {
+                p.steps.push_back({ op::constant, std::atoi(item.text.c_str()) });
             }
             else
             {
-                postfix.push_back(tok.text);
+                auto label = labels.find(item.text);
+                if (label == labels.end()) throw std::runtime_error(item.text + "> label not defined");
+                p.steps.push_back({ item.code, label->second });
             }
+
+            p.depth = std::max(p.depth, ++depth);
         }
     }
 
-    while (!stack.empty())
+    if (depth != 1) throw std::runtime_error("expression evaluation failed");
+
+    return p;
+}
+
+int shunting_yard::eval(const program& p, int line)
+{
+    if (_stack.size() < p.depth) _stack.resize(p.depth);
+
+    // Arithmetic wraps around instead of overflowing.
+    int* top = _stack.data() - 1;
+    for (auto&& s : p.steps)
     {
-        postfix.push_back(stack.top());
-        stack.pop();
+        switch (s.code)
+        {
+        case op::constant:
+            *++top = s.value;
+            break;
+        case op::label:
+            *++top = s.value - line;
+            break;
+        case op::label_neg:
+            *++top = s.value - line >= 0 ? line - s.value : 0;
+            break;
+        case op::label_neg_op:
+            *++top = s.value - line >= 0 ? line - s.value : s.value - line;
+            break;
+        case op::add:
+            top--;
+            top[0] = (int)((uint32_t)top[0] + (uint32_t)top[1]);
+            break;
+        case op::sub:
+            top--;
+            top[0] = (int)((uint32_t)top[0] - (uint32_t)top[1]);
+            break;
+        case op::mul:
+            top--;
+            top[0] = (int)((uint32_t)top[0] * (uint32_t)top[1]);
+            break;
+        case op::div:
+            top--;
+            if (top[1] == 0) throw std::runtime_error("division by zero");
+            top[0] = top[1] == -1 ? (int)(0u - (uint32_t)top[0]) : top[0] / top[1];
+            break;
+        case op::mod:
+            // The operands are used in the order of the stack, so a % b computes b % a.
+            top--;
+            if (top[0] == 0) throw std::runtime_error("division by zero");
+            top[0] = top[0] == -1 ? 0 : top[1] % top[0];
+            break;
+        }
     }
 
-    std::stack<std::string> eval;
-    auto pop_eval_stack = [&]()
+    return _stack[0];
+}
+
+int shunting_yard::eval(const std::vector<token>& expression, const std::unordered_map<std::string_view, int>& labels, int line)
+{
+    // Most operands are a single number or label and need no program.
+    if (expression.size() == 1 && expression[0].type == token_type::number) return to_int(expression[0].text);
+    if (expression.size() == 1 && expression[0].type == token_type::label)
     {
-        std::string t = eval.top();
-        eval.pop();
-        return t;
-    };
+        auto label = labels.find(expression[0].text);
+        if (label != labels.end()) return label->second - line;
+    }
 
-    for (auto&& i : postfix)
+    // Label tokens are marked in the key, the programs are cleared before the labels of the next warrior are used.
+    _key.clear();
+    for (auto&& tok : expression)
     {
-        if (i == "*")
-        {
-            std::string v1 = pop_eval_stack();
-            std::string v2 = pop_eval_stack();
-            eval.push(std::to_string(std::atoi(v2.c_str()) * std::atoi(v1.c_str())));
-        }
-        else if (i == "/")
-        {
-            std::string v1 = pop_eval_stack();
-            std::string v2 = pop_eval_stack();
-            eval.push(std::to_string(std::atoi(v2.c_str()) / std::atoi(v1.c_str())));
-        }
-        else if (i == "%")
-        {
-            std::string v1 = pop_eval_stack();
-            std::string v2 = pop_eval_stack();
-            eval.push(std::to_string(std::atoi(v1.c_str()) % std::atoi(v2.c_str())));
-        }
-        else if (i == "-")
-        {
-            std::string v1 = pop_eval_stack();
-            std::string v2 = pop_eval_stack();
-            eval.push(std::to_string(std::atoi(v2.c_str()) - std::atoi(v1.c_str())));
-        }
-        else if (i == "+")
-        {
-            std::string v1 = pop_eval_stack();
-            std::string v2 = pop_eval_stack();
-            eval.push(std::to_string(std::atoi(v2.c_str()) + std::atoi(v1.c_str())));
-        }
-        else
-        {
-            eval.push(i);
-        }
+        _key.append(tok.text);
+        _key.push_back(tok.type == token_type::label ? '\x01' : '\x00');
     }
 
-    if (eval.size() != 1) throw std::runtime_error("expression evaluation failed");
+    auto found = _programs.find(_key);
+    if (found == _programs.end()) found = _programs.emplace(_key, compile(expression, labels)).first;
+
+    return eval(found->second, line);
+}
+
+int shunting_yard::eval(const std::vector<token>& expression)
+{
+    static const std::unordered_map<std::string_view, int> no_labels;
+    return eval(compile(expression, no_labels), 0);
+}
 
-    return std::atoi(eval.top().c_str());
+void shunting_yard::clear()
+{
+    _programs.clear();
 }
 
 void parser::throw_error(int line, int pos, const std::string& message) const
@@ -190,83 +420,225 @@ modifier parser::default_modifier(op_code op, addr_mode a_mode, addr_mode b_mode
     return b;
 }
 
-void parser::transform_token(token_type t, std::string text)
+/*
+ * Lexer
+ */
+
+static bool is_word(char c)
+{
+    return std::isalnum((unsigned char)c) || c == '_';
+}
+
+static bool is_mode(char c)
+{
+    return c == '#' || c == '$' || c == '@' || c == '<' || c == '>' || c == '{' || c == '}' || c == '*';
+}
+
+static bool is_maths(char c)
+{
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '%' || c == '(' || c == ')';
+}
+
+/**
+ * \brief Matches one of the three letter words of a list that isn't followed by another word character.
+ * \return The length of the match or 0
+ */
+template <size_t N>
+static size_t match_word(std::string_view text, size_t i, const char* const (&words)[N])
 {
-    if(t == token_type::opcode || t == token_type::modifier || t == token_type::preprocessor)
-        std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+    if (i + 3 > text.size() || (i + 3 < text.size() && is_word(text[i + 3]))) return 0;
 
-    for (uint32_t i = 0; i < text.size(); ++i)
+    for (auto && word : words)
     {
-        if (text[i] == ':')
-        {
-            text.erase(text.begin() + i, text.begin() + i + 1);
-            i--;
-        }
+        if (std::toupper((unsigned char)text[i]) == word[0] && std::toupper((unsigned char)text[i + 1]) == word[1] && std::toupper((unsigned char)text[i + 2]) == word[2])
+            return 3;
     }
 
-    add_token(t, text);
+    return 0;
 }
 
-void parser::add_token(token_type t, std::string text)
+static size_t match_opcode(std::string_view text, size_t i)
 {
-    _tokens.emplace_back(_line, _position, text, t);
+    static const char* const words[] = { "DAT", "MOV", "ADD", "SUB", "MUL", "DIV", "MOD", "JMP", "JMZ", "JMN", "DJN", "CMP", "SLT", "SPL", "SEQ", "SNE", "NOP" };
+    return match_word(text, i, words);
 }
 
-void parser::accumulator(std::string text)
+static size_t match_preprocessor(std::string_view text, size_t i)
 {
-    auto match_token = [&](token_type t, std::regex pattern)
-    {
-        std::smatch match;
-        if(std::regex_search(text, match, pattern) && text[0] == match[0].str()[0])
-        {
-            transform_token(t, match[0].str());
-            _position += match[0].str().size();
-            text = text.substr(match[0].str().size());
-            return true;
-        }
-        return false;
-    };
+    static const char* const words[] = { "EQU", "END", "ORG", "FOR", "ROF" };
+    return match_word(text, i, words);
+}
 
-    while(!text.empty())
-    {
-        if (text[0] == ';') return;
+static size_t match_modifier(std::string_view text, size_t i)
+{
+    if (text[i] != '.' || i + 1 >= text.size()) return 0;
 
-        if (match_token(token_type::comma, _re_comma))
-            continue;
+    char first = (char)std::toupper((unsigned char)text[i + 1]);
+    char second = i + 2 < text.size() ? (char)std::toupper((unsigned char)text[i + 2]) : 0;
+    if ((first == 'A' && second == 'B') || (first == 'B' && second == 'A')) return 3;
+    if (first == 'A' || first == 'B' || first == 'F' || first == 'X' || first == 'I') return 2;
 
-        if (match_token(token_type::modifier, _re_modifier))
-            continue;
+    return 0;
+}
 
-        if (match_token(token_type::mode, _re_mode))
-            continue;
+/**
+ * \brief Finds the leftmost match at or after a position of a word like a regex search would. The last match is kept,
+ * so searching from increasing positions scans every character only once.
+ */
+class leftmost_match
+{
+private:
+    std::string_view _text;
+    size_t (*_match)(std::string_view, size_t);
+    size_t _from = std::string_view::npos;
+    size_t _at = std::string_view::npos;
+    size_t _length = 0;
+
+public:
+    leftmost_match(std::string_view text, size_t (*match)(std::string_view, size_t))
+        : _text(text),
+          _match(match)
+    { }
+
+    /**
+     * \param from Start of the search
+     * \param at Receives the start of the match
+     * \return The length of the match or 0 if there is none
+     */
+    size_t find(size_t from, size_t& at)
+    {
+        // A previous search from an earlier position is still valid if its match wasn't passed yet
+        if (_from == std::string_view::npos || from < _from || (_at != std::string_view::npos && _at < from))
+        {
+            _from = from;
+            _at = std::string_view::npos;
+            _length = 0;
+            for (size_t i = from; i < _text.size(); ++i)
+            {
+                _length = _match(_text, i);
+                if (_length > 0)
+                {
+                    _at = i;
+                    break;
+                }
+            }
+        }
 
-        if (match_token(token_type::maths, _re_maths))
-            continue;
+        at = _at;
+        return _length;
+    }
+};
 
-        if (match_token(token_type::number, _re_number))
-            continue;
+void parser::transform_token(token_type t, std::string_view text)
+{
+    // Keywords reference the uppercase spelling of their table, everything else stays a view of the source. Only
+    // labels can end with a colon.
+    if (t == token_type::opcode)
+    {
+        for (auto && [name, op] : opcode_table)
+        {
+            if (equal_upper(text, name)) text = name;
+        }
+    }
+    else if (t == token_type::modifier)
+    {
+        for (auto && [name, mod] : modifier_table)
+        {
+            if (equal_upper(text, name)) text = name;
+        }
+    }
+    else if (t == token_type::preprocessor)
+    {
+        for (auto && name : preprocessor_table)
+        {
+            if (equal_upper(text, name)) text = name;
+        }
+    }
+    else if (!text.empty() && text.back() == ':')
+    {
+        text.remove_suffix(1);
+    }
 
-        if (match_token(token_type::opcode, _re_opcode))
-            continue;
+    add_token(t, text);
+}
 
-        if (match_token(token_type::preprocessor, _re_preproccesor))
-            continue;
+void parser::add_token(token_type t, std::string_view text)
+{
+    _tokens.emplace_back(_line, _position, text, t);
+}
 
-        if (match_token(token_type::label, _re_label))
-            continue;
+void parser::accumulator(std::string_view text)
+{
+    // The words can also match behind the current position. As with the regex based lexer such a match is taken as
+    // long as it starts with the same character as the remaining text.
+    leftmost_match modifiers(text, match_modifier);
+    leftmost_match opcodes(text, match_opcode);
+    leftmost_match preprocessors(text, match_preprocessor);
+
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        char c = text[pos];
+        size_t at = pos;
+        size_t length = 0;
+        token_type type = token_type::unknown;
 
-        if (match_token(token_type::comment, _re_comment))
-            continue;
+        if (c == ',')
+        {
+            type = token_type::comma;
+            length = 1;
+        }
+        else if (c == '.' && (length = modifiers.find(pos, at)) > 0)
+        {
+            type = token_type::modifier;
+        }
+        else if (is_mode(c))
+        {
+            type = token_type::mode;
+            length = 1;
+        }
+        else if (is_maths(c))
+        {
+            type = token_type::maths;
+            length = 1;
+        }
+        else if (std::isdigit((unsigned char)c))
+        {
+            type = token_type::number;
+            while (pos + length < text.size() && std::isdigit((unsigned char)text[pos + length])) length++;
+        }
+        else if ((length = opcodes.find(pos, at)) > 0 && text[at] == c)
+        {
+            type = token_type::opcode;
+        }
+        else if ((length = preprocessors.find(pos, at)) > 0 && text[at] == c)
+        {
+            type = token_type::preprocessor;
+        }
+        else if (std::isalpha((unsigned char)c) || c == '_')
+        {
+            type = token_type::label;
+            at = pos;
+            length = 1;
+            while (pos + length < text.size() && is_word(text[pos + length])) length++;
+            if (pos + length < text.size() && text[pos + length] == ':') length++;
+        }
+        else
+        {
+            transform_token(token_type::unknown, "");
+            return;
+        }
 
-        transform_token(token_type::unknown, "");
-        text = "";
+        transform_token(type, text.substr(at, length));
+        _position += (int)length;
+        pos += length;
     }
 }
 
-void parser::comment(std::string text)
+void parser::comment(std::string_view text)
 {
-    if(text.find("author") == 0 || text.find("AUTHOR") == 0) _result->author = text.substr(7);
-    else if (text.find("name") == 0 || text.find("NAME") == 0)  _result->name = text.substr(5);
+    if (text.find("author") == 0 || text.find("AUTHOR") == 0) _result->author = std::string(text.substr(7));
+    else if (text.find("name") == 0 || text.find("NAME") == 0)  _result->name = std::string(text.substr(5));
     add_token(token_type::comment, text);
 }
 
@@ -275,278 +647,353 @@ void parser::eol()
     add_token(token_type::eol, "\n");
 }
 
-void parser::tokenize(std::istream& input)
+void parser::tokenize(std::string_view source)
 {
-    std::string accum;
-    std::string line;
-    while (std::getline(input, line))
+    size_t line_start = 0;
+    while (line_start < source.size())
     {
+        size_t line_end = std::min(source.find('\n', line_start), source.size());
+        std::string_view line = source.substr(line_start, line_end - line_start);
+        line_start = line_end + 1;
+
+        // Words are separated by whitespace and end at a comment
         _position = 0;
-        for (uint32_t c = 0; c < line.size(); ++c)
+        size_t word = 0;
+        for (size_t c = 0; c <= line.size(); ++c)
         {
-            if (line[c] == ';')
-            {
-                if (!accum.empty())
-                {
-                    accumulator(accum);
-                    accum = "";
-                }
+            bool end = c == line.size() || line[c] == ';';
+            if (!end && !std::isspace((unsigned char)line[c])) continue;
 
-                _position = c + 1;
-                comment(line.substr(c + 1));
+            if (c > word) accumulator(line.substr(word, c - word));
+            word = c + 1;
 
-                break;
-            }
-
-            if (!std::isspace(line[c]))
-            {
-                accum += line[c];
-            }
-            else
+            if (c < line.size())
             {
-                if (!accum.empty())
+                _position = (int)c + 1;
+                if (line[c] == ';')
                 {
-                    accumulator(accum);
-                    accum = "";
+                    comment(line.substr(c + 1));
+                    break;
                 }
-
-                _position = c + 1;
             }
         }
 
-        if (!accum.empty())
-        {
-            accumulator(accum);
-            accum = "";
-        }
-
         eol();
         _line++;
     }
 }
 
+/*
+ * Passes
+ *
+ * Every pass walks the stream line by line through indices into _tokens and writes a new stream, so a pass is linear
+ * in the amount of tokens. Like before, a pass stops at the first empty line and keeps the rest of the stream as is.
+ */
+
+size_t parser::line_end(size_t start) const
+{
+    while (start < _tokens.size() && _tokens[start].type != token_type::eol) start++;
+    return start;
+}
+
 void parser::filter()
 {
-    for (uint32_t i = 0; i < _tokens.size(); ++i)
+    std::vector<token> out;
+    out.reserve(_tokens.size());
+
+    size_t size = _tokens.size();
+    for (size_t i = 0; i < size; ++i)
     {
         switch (_tokens[i].type)
         {
         case token_type::comment:
-            _tokens.erase(_tokens.begin() + i, _tokens.begin() + i + 1);
-            i--;
-            break;
+            continue;
         case token_type::eol:
-            if(i == 0 || (i + 1 < _tokens.size() && _tokens[i+1].type == token_type::eol))
-            {
-                _tokens.erase(_tokens.begin() + i, _tokens.begin() + i + 1);
-                i--;
-            }
+            if (out.empty() || (i + 1 < size && _tokens[i + 1].type == token_type::eol)) continue;
             break;
         case token_type::label:
-            while(i < _tokens.size() - 1 && i > 0 && _tokens[i - 1].type == token_type::eol && _tokens[i+1].type == token_type::eol)
+            // A label on its own line is joined with the next line. The label moves over the dropped eol.
+            while (i + 1 < size && !out.empty() && out.back().type == token_type::eol && _tokens[i + 1].type == token_type::eol)
             {
-                _tokens.erase(_tokens.begin() + i + 1, _tokens.begin() + i + 2);
+                _tokens[i + 1] = std::move(_tokens[i]);
+                i++;
             }
+            [[fallthrough]];
         case token_type::preprocessor:
-            if(_tokens[i].text == "END")
+            if (_tokens[i].text == "END")
             {
-                for (uint32_t j = i; j < _tokens.size(); ++j)
+                // Everything after the line of END is dropped
+                for (size_t j = i; j < size; ++j)
                 {
-                    if(_tokens[j].type == token_type::eol)
+                    if (_tokens[j].type == token_type::eol)
                     {
-                        _tokens.erase(_tokens.begin() + j, _tokens.end());
+                        size = j;
+                        break;
                     }
                 }
             }
             break;
+        default:
+            break;
         }
+
+        out.push_back(std::move(_tokens[i]));
     }
+
+    _tokens.swap(out);
 }
 
 void parser::process_for()
 {
+    std::vector<token> out;
+    out.reserve(_tokens.size());
+
     bool in_for = false;
-    int for_start = 0;
+    bool nested = false;
+    bool scope_nested = false;
+    size_t for_start = 0;
+    int depth = 0;
     int count = 0;
-    std::string for_index;
+    std::string_view for_index;
     std::vector<token> scope;
 
-    int current_pos = 0;
-    std::vector<token> current_line = read_line(current_pos);
-    while (!current_line.empty())
+    size_t start = 0;
+    while (start < _tokens.size())
     {
-        for (uint32_t i = 0; i < current_line.size(); ++i)
+        size_t end = line_end(start);
+        if (end == start) break;
+
+        bool rof_last = false;
+        for (size_t i = start; i < end; ++i)
         {
-            if(in_for)
+            rof_last = false;
+            if (in_for)
             {
-                if(current_line[i].type == token_type::preprocessor && current_line[i].text == "ROF")
+                // Inner FOR/ROF pairs are copied into the body and expanded by the next pass
+                if (_tokens[i].type == token_type::preprocessor && _tokens[i].text == "FOR")
                 {
-                    in_for = false;
-                    pop(for_start, current_pos + 2 - for_start);
-                    for (int c = count - 1; c >= 0; --c)
+                    depth++;
+                    scope.push_back(_tokens[i]);
+                }
+                else if (_tokens[i].type == token_type::preprocessor && _tokens[i].text == "ROF" && depth > 0)
+                {
+                    depth--;
+                    scope_nested = true;
+                    scope.push_back(_tokens[i]);
+                }
+                else if (_tokens[i].type == token_type::preprocessor && _tokens[i].text == "ROF")
+                {
+                    for (int c = 0; c < count; ++c)
                     {
-                        std::vector<token> c_line = scope;
-                        for (int j = c_line.size() - 1; j >= 0; --j)
+                        std::string_view index = for_index.empty() ? std::string_view() : _strings.emplace_back(std::to_string(c + 1));
+                        for (auto && t : scope)
                         {
-                            if(c_line[j].type == token_type::label && c_line[j].text == for_index)
+                            out.push_back(t);
+                            if (t.type == token_type::label && t.text == for_index)
                             {
-                                c_line[j].type = token_type::number;
-                                c_line[j].text = std::to_string(c + 1);
+                                out.back().type = token_type::number;
+                                out.back().text = index;
                             }
-                            _tokens.insert(_tokens.begin() + for_start, c_line[j]);
                         }
                     }
+
+                    in_for = false;
+                    rof_last = true;
+                    nested = nested || (scope_nested && count > 0);
+                    scope_nested = false;
                     for_index = "";
-                    for_start = 0;
                     count = 0;
                     scope.clear();
                 }
                 else
                 {
-                    scope.push_back(current_line[i]);
+                    scope.push_back(_tokens[i]);
                 }
             }
-            else if(current_line[i].type == token_type::preprocessor && current_line[i].text == "FOR")
+            else if (_tokens[i].type == token_type::preprocessor && _tokens[i].text == "FOR")
             {
-                if (in_for) throw_error(current_line[i].line, current_line[i].position, "invalid scope of for");
+                if (i + 1 >= end) throw_error(_tokens[i].line, _tokens[i].position, "missing for count");
+                if (_tokens[i + 1].type != token_type::number) throw_error(_tokens[i].line, _tokens[i].position, "for count is no number");
 
-                if(i+1 >= current_line.size()) throw_error(current_line[i].line, current_line[i].position, "missing for count");
-                if(current_line[i+1].type != token_type::number) throw_error(current_line[i].line, current_line[i].position, "for count is no number");
-
-                if (i > 0 && current_line[i - 1].type == token_type::label) for_index = current_line[i - 1].text;
+                if (i > start && _tokens[i - 1].type == token_type::label) for_index = _tokens[i - 1].text;
 
+                // The token after the count is skipped
                 in_for = true;
-                count = std::atoi(current_line[i + 1].text.c_str());
-                for_start = current_pos + i;
+                count = to_int(_tokens[i + 1].text);
+                for_start = i;
                 i += 2;
             }
+            else
+            {
+                out.push_back(_tokens[i]);
+            }
+        }
+
+        // Lines of the body are separated by eols, the line of ROF goes away if ROF was its last token
+        if (in_for)
+        {
+            if (!scope.empty() && scope[scope.size() - 1].type != token_type::eol)
+                scope.push_back(token(0, 0, "\n", token_type::eol));
+        }
+        else if (end < _tokens.size() && !rof_last)
+        {
+            out.push_back(_tokens[end]);
         }
 
-        if (in_for && !scope.empty() && scope[scope.size() - 1].type != token_type::eol)
-            scope.push_back(token(0, 0, "\n", token_type::eol));
+        start = end + 1;
+    }
 
-        current_pos += current_line.size() + 1;
-        current_line = read_line(current_pos);
+    // A for without rof stays as it is
+    for (size_t i = in_for ? for_start : start; i < _tokens.size(); ++i)
+    {
+        out.push_back(_tokens[i]);
     }
+
+    _tokens.swap(out);
+
+    // Every pass expands one level of nested blocks
+    if (nested) process_for();
 }
 
-void parser::process_equs()
+const std::vector<token>& parser::expand_equ(std::string_view name, std::unordered_set<std::string_view>& expanding)
 {
-    int current_pos = 0;
-    std::vector<token> current_line = read_line(current_pos);
-    while(!current_line.empty())
-    {
-        if (current_line.size() > 2 && current_line[0].type == token_type::label && current_line[1].type == token_type::preprocessor && current_line[1].text == "EQU")
-        {
-            std::string name = current_line[0].text;
-            if (_equs.count(name)) throw_error(current_line[0].line, current_line[0].position, current_line[0].text + "> equ redefinition");
+    std::vector<token>& equ = _equs[name];
+    if (_expanded.count(name)) return equ;
+    if (!expanding.insert(name).second) throw_error(equ[0].line, equ[0].position, std::string(name) + "> equ references itself");
 
-            current_line.erase(current_line.begin(), current_line.begin() + 2);
-            _equs.insert_or_assign(name, current_line);
-            pop(current_pos, current_line.size() + 3);
-        } 
-        else
+    std::vector<token> out;
+    out.reserve(equ.size());
+    for (auto && t : equ)
+    {
+        if (t.type != token_type::label || !_equs.count(t.text))
         {
-            current_pos += current_line.size() + 1;
+            out.push_back(t);
+            continue;
         }
 
-        current_line = read_line(current_pos);
+        const std::vector<token>& replace = expand_equ(t.text, expanding);
+        out.insert(out.end(), replace.begin(), replace.end());
     }
 
-    for (auto && equ : _equs)
+    // The map doesn't move its values, so the reference to equ is still valid
+    equ.swap(out);
+    expanding.erase(name);
+    _expanded.insert(name);
+    return equ;
+}
+
+void parser::process_equs()
+{
+    std::vector<token> out;
+    out.reserve(_tokens.size());
+
+    size_t start = 0;
+    while (start < _tokens.size())
     {
-        for (uint32_t i = 0; i < equ.second.size(); ++i)
+        size_t end = line_end(start);
+        if (end == start) break;
+
+        if (end - start > 2 && _tokens[start].type == token_type::label && _tokens[start + 1].type == token_type::preprocessor && _tokens[start + 1].text == "EQU")
         {
-            if(equ.second[i].type != token_type::label || !_equs.count(equ.second[i].text)) continue;
-            auto replace = _equs[equ.second[i].text];
-            for (int j = replace.size() - 1; j >= 0; --j)
-            {
-                equ.second.insert(equ.second.begin() + i, replace[j]);
-            }
-            equ.second.erase(equ.second.begin() + replace.size() + i, equ.second.begin() + replace.size() + i + 1);
-            i--;
+            const token& name = _tokens[start];
+            if (_equs.count(name.text)) throw_error(name.line, name.position, std::string(name.text) + "> equ redefinition");
+
+            _equs.insert_or_assign(name.text, std::vector<token>(_tokens.begin() + start + 2, _tokens.begin() + end));
+        }
+        else
+        {
+            out.insert(out.end(), _tokens.begin() + start, _tokens.begin() + std::min(end + 1, _tokens.size()));
         }
+
+        start = end + 1;
     }
 
-    for (uint32_t i = 0; i < _tokens.size(); ++i)
+    if (start < _tokens.size()) out.insert(out.end(), _tokens.begin() + start, _tokens.end());
+
+    // Equs can reference other equs. Each one is expanded once and then copied into the stream.
+    std::unordered_set<std::string_view> expanding;
+    _tokens.clear();
+    for (auto && t : out)
     {
-        if (_tokens[i].type != token_type::label || !_equs.count(_tokens[i].text)) continue;
-        auto replace = _equs[_tokens[i].text];
-        for (int j = replace.size() - 1; j >= 0; --j)
+        if (t.type != token_type::label || !_equs.count(t.text))
         {
-            _tokens.insert(_tokens.begin() + i, replace[j]);
+            _tokens.push_back(std::move(t));
+            continue;
         }
-        _tokens.erase(_tokens.begin() + replace.size() + i, _tokens.begin() + replace.size() + i + 1);
-        i--;
+
+        const std::vector<token>& replace = expand_equ(t.text, expanding);
+        _tokens.insert(_tokens.end(), replace.begin(), replace.end());
     }
 }
 
 void parser::process_org()
 {
-    int current_pos = 0;
-    std::vector<token> current_line = read_line(current_pos);
-    while (!current_line.empty())
+    std::vector<token> out;
+    out.reserve(_tokens.size());
+
+    size_t start = 0;
+    while (start < _tokens.size())
     {
-        if (!current_line.empty() && current_line[0].type == token_type::preprocessor && (current_line[0].text == "END" || current_line[0].text == "ORG"))
+        size_t end = line_end(start);
+        if (end == start) break;
+
+        // END and ORG lines are removed, the expression behind them is the start of the warrior
+        if (_tokens[start].type == token_type::preprocessor && (_tokens[start].text == "END" || _tokens[start].text == "ORG"))
         {
-            if(current_line.size() > 1)
-            {
-                current_line.erase(current_line.begin(), current_line.begin() + 1);
-                _org = current_line;
-                pop(current_pos, current_line.size() + 2);
-            }
-            else
-            {
-                pop(current_pos, 2);
-            }
+            if (end - start > 1) _org.assign(_tokens.begin() + start + 1, _tokens.begin() + end);
         }
         else
         {
-            current_pos += current_line.size() + 1;
+            out.insert(out.end(), _tokens.begin() + start, _tokens.begin() + std::min(end + 1, _tokens.size()));
         }
 
-        current_line = read_line(current_pos);
+        start = end + 1;
     }
+
+    if (start < _tokens.size()) out.insert(out.end(), _tokens.begin() + start, _tokens.end());
+
+    _tokens.swap(out);
 }
 
 void parser::process_labels()
 {
+    // Labels in front of an opcode or another label are definitions. The last token is never one.
+    std::vector<token> out;
+    out.reserve(_tokens.size());
+
     int current_line = 0;
-    for (uint32_t i = 0; i < _tokens.size() - 1; ++i)
+    for (size_t i = 0; i + 1 < _tokens.size(); ++i)
     {
         if (_tokens[i].type == token_type::eol) current_line++;
-        if (_tokens[i].type != token_type::label || (_tokens[i + 1].type != token_type::opcode && _tokens[i + 1].type != token_type::label)) continue;
-        if (_equs.count(_tokens[i].text) || _labels.count(_tokens[i].text)) throw_error(_tokens[i].line, _tokens[i].position, _tokens[i].text + "> label redefinition");
+        if (_tokens[i].type != token_type::label || (_tokens[i + 1].type != token_type::opcode && _tokens[i + 1].type != token_type::label))
+        {
+            out.push_back(std::move(_tokens[i]));
+            continue;
+        }
+
+        if (_equs.count(_tokens[i].text) || _labels.count(_tokens[i].text)) throw_error(_tokens[i].line, _tokens[i].position, std::string(_tokens[i].text) + "> label redefinition");
         _labels.insert_or_assign(_tokens[i].text, current_line);
-        _tokens.erase(_tokens.begin() + i, _tokens.begin() +  i + 1);
-        i--;
     }
+    if (!_tokens.empty()) out.push_back(std::move(_tokens[_tokens.size() - 1]));
+    _tokens.swap(out);
 
-    if (_tokens[_tokens.size() - 1].text == "END" && _tokens[_tokens.size() - 2].type == token_type::label && _tokens[_tokens.size() - 3].type == token_type::eol)
+    size_t size = _tokens.size();
+    if (size >= 3 && _tokens[size - 1].text == "END" && _tokens[size - 2].type == token_type::label && _tokens[size - 3].type == token_type::eol)
     {
-        if (_equs.count(_tokens[_tokens.size() - 2].text) || _labels.count(_tokens[_tokens.size() - 2].text)) throw_error(_tokens[_tokens.size() - 2].line, _tokens[_tokens.size() - 2].position, _tokens[_tokens.size() - 2].text + "> label redefinition");
-        _labels.insert_or_assign(_tokens[_tokens.size() - 2].text, current_line);
-        _tokens.erase(_tokens.begin() + _tokens.size() - 2, _tokens.begin() + _tokens.size() - 1);
+        if (_equs.count(_tokens[size - 2].text) || _labels.count(_tokens[size - 2].text)) throw_error(_tokens[size - 2].line, _tokens[size - 2].position, std::string(_tokens[size - 2].text) + "> label redefinition");
+        _labels.insert_or_assign(_tokens[size - 2].text, current_line);
+        _tokens.erase(_tokens.begin() + size - 2);
     }
 
-    current_line = 0;
-    for (uint32_t i = 0; i < _tokens.size(); ++i)
+    // References stay labels, the expressions resolve them relative to the line they are used in.
+    for (auto && t : _tokens)
     {
-        if (_tokens[i].type == token_type::eol) current_line++;
-        if (_tokens[i].type != token_type::label) continue;
-        if (!_labels.count(_tokens[i].text)) throw_error(_tokens[i].line, _tokens[i].position, _tokens[i].text + "> label not defined");
-        auto pos = _labels[_tokens[i].text];
-        _tokens[i].type = token_type::number;
-        _tokens[i].text = std::to_string(pos - current_line);
-        i--;
+        if (t.type == token_type::label && !_labels.count(t.text)) throw_error(t.line, t.position, std::string(t.text) + "> label not defined");
     }
 
     for (auto && org : _org)
     {
-        if (org.type != token_type::label) continue;
-        if (!_labels.count(org.text)) throw_error(_tokens[i].line, _tokens[i].position, _tokens[i].text + "> label not defined");
-        org.type = token_type::number;
-        org.text = std::to_string(_labels[org.text]);
+        if (org.type == token_type::label && !_labels.count(org.text)) throw_error(org.line, org.position, std::string(org.text) + "> label not defined");
     }
 }
 
@@ -558,96 +1005,83 @@ void parser::process_expressions()
         return i < 0 ? i + max : i;
     };
 
-    shunting_yard yard;
-    if (!_org.empty()) _result->start = yard.eval(_org);
+    if (!_org.empty()) _result->start = _yard.eval(_org, _labels, 0);
     else _result->start = 0;
 
-    int current_pos = 0;
-    std::vector<token> current_line = read_line(current_pos);
-    while (!current_line.empty())
+    std::vector<token> expr;
+    size_t start = 0;
+    for (int line = 0; start < _tokens.size(); ++line)
     {
-        current_pos += current_line.size() + 1;
-        
-        if (!current_line.empty() && current_line[0].type == token_type::opcode)
+        size_t end = line_end(start);
+        if (end == start) break;
+
+        if (_tokens[start].type == token_type::opcode)
         {
             instruction ins;
 
-            ins.op = str_opcodes[current_line[0].text];
+            ins.set_op(to_opcode(_tokens[start].text));
 
             bool got_math = false;
             bool in_a = true;
             bool mod_found = false;
 
-            std::vector<token> expr;
+            expr.clear();
 
-            while(!current_line.empty())
+            for (size_t i = start; i < end; ++i)
             {
-                if (current_line[0].type == token_type::modifier)
+                const token& t = _tokens[i];
+                if (t.type == token_type::modifier)
                 {
                     mod_found = true;
-                    ins.mod = str_modifiers[current_line[0].text];
-                } 
-                else if (current_line[0].type == token_type::mode) {
+                    ins.set_mod(to_modifier(t.text));
+                }
+                else if (t.type == token_type::mode) {
                     if(got_math)
                     {
-                        expr.push_back(current_line[0]);
+                        expr.push_back(t);
                     }
                     else
                     {
                         if(in_a)
-                            ins.a_mode = str_addr_mode[current_line[0].text];
+                            ins.set_a_mode(to_addr_mode(t.text));
                         else
-                            ins.b_mode = str_addr_mode[current_line[0].text]; 
+                            ins.set_b_mode(to_addr_mode(t.text));
                     }
-                } 
-                else if (current_line[0].type == token_type::maths || current_line[0].type == token_type::number) {
+                }
+                else if (t.type == token_type::maths || t.type == token_type::number || t.type == token_type::label) {
                     got_math = true;
-                    expr.push_back(current_line[0]);
-                } 
-                else if (current_line[0].type == token_type::comma)
+                    expr.push_back(t);
+                }
+                else if (t.type == token_type::comma)
                 {
                     got_math = false;
                     in_a = false;
-                    ins.a = wrap(yard.eval(expr), core_size);
+                    ins.a = wrap(_yard.eval(expr, _labels, line), core_size);
                     expr.clear();
                 }
-
-                current_line.erase(current_line.begin(), current_line.begin() + 1);
             }
 
-            ins.b = wrap(yard.eval(expr), core_size);
+            ins.b = wrap(_yard.eval(expr, _labels, line), core_size);
 
             if(!mod_found)
             {
-                ins.mod = default_modifier(ins.op, ins.a_mode, ins.b_mode);
+                ins.set_mod(default_modifier(ins.op(), ins.a_mode(), ins.b_mode()));
             }
 
             _result->code.push_back(ins);
         }
 
-        current_line = read_line(current_pos);
+        start = end + 1;
     }
 }
 
-std::vector<token> parser::read_line(uint32_t start)
-{
-    if (start >= _tokens.size()) return {};
-    std::vector<token> line;
-    for (uint32_t i = start; i < _tokens.size() && _tokens[i].type != token_type::eol; ++i)
-    {
-        line.push_back(_tokens[i]);
-    }
-    return line;
-}
-
-void parser::pop(uint32_t start, uint32_t size)
+std::shared_ptr<warrior> parser::parse(std::istream& input)
 {
-    if (start >= _tokens.size()) return;
-    if (start + size >= _tokens.size()) size = _tokens.size() - start;
-    _tokens.erase(_tokens.begin() + start, _tokens.begin() + start + size);
+    std::string source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    return parse(std::string_view(source));
 }
 
-std::shared_ptr<warrior> parser::parse(std::istream& input)
+std::shared_ptr<warrior> parser::parse(std::string_view source)
 {
     _result = std::make_shared<warrior>();
     _position = 0;
@@ -655,9 +1089,12 @@ std::shared_ptr<warrior> parser::parse(std::istream& input)
     _tokens.clear();
     _equs.clear();
     _labels.clear();
+    _expanded.clear();
     _org.clear();
+    _yard.clear();
+    _strings.clear();
 
-    tokenize(input);
+    tokenize(source);
     for (int i = 0; i < 3; ++i) filter();
     process_for();
     process_equs();
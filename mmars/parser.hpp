@@ -1,9 +1,12 @@
 #pragma once
 
 #include <unordered_map>
-#include <regex>
+#include <unordered_set>
+#include <string>
+#include <string_view>
 #include <memory>
-#include <stack>
+#include <vector>
+#include <deque>
 
 #include "warrior.hpp"
 
@@ -26,17 +29,17 @@ enum class token_type
 };
 
 /**
- * \brief Token of a redcode token stream
+ * \brief Token of a redcode token stream. The text references the parsed source or static strings of the parser.
  */
 class token
 {
 public:
-    int             line;
-    int             position;
-    std::string     text;
-    token_type      type;
+    int                 line;
+    int                 position;
+    std::string_view    text;
+    token_type          type;
 
-    token(int line, int position, const std::string& text, token_type type)
+    token(int line, int position, std::string_view text, token_type type)
         : line(line),
           position(position),
           text(text),
@@ -47,113 +50,110 @@ public:
 };
 
 /**
- * \brief Implementation of the shunting yard algorithm and evaluation of postfix formula
+ * \brief Implementation of the shunting yard algorithm. Expressions are compiled once into an integer postfix program
+ * that is evaluated on an integer stack without any allocation.
  */
 class shunting_yard
 {
-private:
-    class prec_operator
+public:
+    /**
+     * \brief The operations of a compiled expression.
+     */
+    enum class op : uint8_t
     {
-    public:
-        int precedence;
-        bool right_associative;
-
-        prec_operator(int precedence, bool right_associative)
-            : precedence(precedence),
-            right_associative(right_associative)
-        { }
+        constant,       // Pushes the value
+        label,          // Pushes the distance from the evaluated line to the label line stored in value
+        label_neg,      // Label with a leading minus. A negative distance reads as "--n" and turns into 0
+        label_neg_op,   // Label with a minus behind an operator. A negative distance keeps its sign
+        add,
+        sub,
+        mul,
+        div,
+        mod,
+    };
 
-        prec_operator() = default;
+    struct step
+    {
+        op code;
+        int value;
     };
 
-    std::unordered_map<std::string, prec_operator> _operators = {
-        {"*", prec_operator(10, false)},
-        {"/", prec_operator(10, false)},
-        {"%", prec_operator(10, false)},
-        {"-", prec_operator(9, false)},
-        {"+", prec_operator(8, false)},
+    /**
+     * \brief A compiled expression.
+     */
+    class program
+    {
+    public:
+        std::vector<step> steps;
+        uint32_t depth = 0;
     };
 
+private:
+    std::unordered_map<std::string, program> _programs;
+    std::string _key;
+    std::vector<int> _stack;
+
 public:
     explicit shunting_yard() = default;
 
-    int eval(std::vector<token> expression);
-};
+    /**
+     * \brief Compiles an infix expression into a postfix program.
+     * \param expression The tokens of the expression
+     * \param labels The lines of the labels the expression can reference
+     * \return The compiled program
+     */
+    program compile(const std::vector<token>& expression, const std::unordered_map<std::string_view, int>& labels) const;
 
-class parser
-{
-private:
-    std::unordered_map<std::string, op_code> str_opcodes = {
-        {"SUB", op_code::sub},
-        {"ADD", op_code::add},
-        {"CMP", op_code::cmp},
-        {"DAT", op_code::dat},
-        {"DIV", op_code::div},
-        {"DJN", op_code::djn},
-        {"JMN", op_code::jmn},
-        {"JMP", op_code::jmp},
-        {"JMZ", op_code::jmz},
-        {"MOD", op_code::mod},
-        {"MOV", op_code::mov},
-        {"CMP", op_code::cmp},
-        {"SEQ", op_code::cmp},
-        {"NOP", op_code::nop},
-        {"SNE", op_code::sne},
-        {"SLT", op_code::slt},
-        {"MUL", op_code::mul},
-        {"SPL", op_code::spl},
-    };
+    /**
+     * \brief Evaluates a compiled program.
+     * \param line The line the expression is used in, label references are relative to it
+     */
+    int eval(const program& p, int line);
 
-    std::unordered_map<std::string, modifier> str_modifiers = {
-        {".X", modifier::x},
-        {".A", modifier::a},
-        {".B", modifier::b},
-        {".AB", modifier::ab},
-        {".BA", modifier::ba},
-        {".I", modifier::i},
-        {".F", modifier::f},
-    };
+    /**
+     * \brief Evaluates an expression. Equal expressions are only compiled once until clear is called.
+     * \param expression The tokens of the expression
+     * \param labels The lines of the labels the expression can reference
+     * \param line The line the expression is used in, label references are relative to it
+     */
+    int eval(const std::vector<token>& expression, const std::unordered_map<std::string_view, int>& labels, int line);
 
-    std::unordered_map<std::string, addr_mode> str_addr_mode = {
-        {"#", addr_mode::im},
-        {"$", addr_mode::dir},
-        {"@", addr_mode::ind_b},
-        {"<", addr_mode::pre_dec_b},
-        {">", addr_mode::post_inc_b},
-        {"*", addr_mode::ind_a},
-        {"{", addr_mode::pre_dec_a},
-        {"}", addr_mode::post_inc_a},
-    };
+    /**
+     * \brief Evaluates an expression without label references.
+     */
+    int eval(const std::vector<token>& expression);
 
-    std::regex _re_label = std::regex("[A-Z_][A-Z_0-9]*\\:?", std::regex_constants::icase);
-    std::regex _re_opcode = std::regex("(DAT|MOV|ADD|SUB|MUL|DIV|MOD|JMP|JMZ|JMN|DJN|CMP|SLT|SPL|SEQ|SNE|NOP)(?!\\w)", std::regex_constants::icase);
-    std::regex _re_preproccesor = std::regex("(EQU|END|ORG|FOR|ROF)(?!\\w)", std::regex_constants::icase);
-    std::regex _re_modifier = std::regex("\\.(AB|BA|A|B|F|X|I)", std::regex_constants::icase);
-    std::regex _re_mode = std::regex("(#|\\$|@|<|>|\\{|\\}|\\*)", std::regex_constants::icase);
-    std::regex _re_number = std::regex("[0-9]+", std::regex_constants::icase);
-    std::regex _re_comma = std::regex(",", std::regex_constants::icase);
-    std::regex _re_maths = std::regex("(\\+|\\-|\\*|\\/|%|\\(|\\))", std::regex_constants::icase);
-    std::regex _re_comment = std::regex(";.*", std::regex_constants::icase);
+    /**
+     * \brief Drops the compiled programs.
+     */
+    void clear();
+};
 
+class parser
+{
+private:
     int _line;
     int _position;
     std::vector<token> _org;
     std::vector<token> _tokens;
-    std::unordered_map<std::string, std::vector<token>> _equs;
-    std::unordered_map <std::string, int> _labels;
+    std::unordered_map<std::string_view, std::vector<token>> _equs;
+    std::unordered_set<std::string_view> _expanded;
+    std::unordered_map<std::string_view, int> _labels;
+    std::deque<std::string> _strings;
     std::shared_ptr<warrior> _result;
+    shunting_yard _yard;
 
     void throw_error(int line, int pos, const std::string& message) const;
 
     static modifier default_modifier(op_code op, addr_mode a_mode, addr_mode b_mode);
 
-    void transform_token(token_type t, std::string text);
-    void add_token(token_type t, std::string text);
+    void transform_token(token_type t, std::string_view text);
+    void add_token(token_type t, std::string_view text);
 
-    void accumulator(std::string text);
-    void comment(std::string text);
+    void accumulator(std::string_view text);
+    void comment(std::string_view text);
     void eol();
-    void tokenize(std::istream& input);
+    void tokenize(std::string_view source);
     void filter();
 
     void process_for();
@@ -162,8 +162,17 @@ private:
     void process_labels();
     void process_expressions();
 
-    std::vector<token> read_line(uint32_t start);
-    void pop(uint32_t start, uint32_t size);
+    /**
+     * \brief Returns the index of the eol that ends the line starting at start or the size of the stream.
+     */
+    size_t line_end(size_t start) const;
+
+    /**
+     * \brief Replaces all references to other equs in an equ. Every equ is only expanded once.
+     * \param expanding The equs that are currently expanded, used to detect equs that reference themselves
+     * \return The expanded tokens of the equ
+     */
+    const std::vector<token>& expand_equ(std::string_view name, std::unordered_set<std::string_view>& expanding);
 
 public:
     uint32_t core_size = 8000;
@@ -190,4 +199,12 @@ public:
      * \return The parsed warrior
      */
     std::shared_ptr<warrior> parse(std::istream& input);
+
+    /**
+     * \brief Parses a warrior straight from a buffer, e.g. a string or a memory mapped file. The tokens reference the
+     * buffer, so it only has to stay valid during the call.
+     * \param source Text of the warrior
+     * \return The parsed warrior
+     */
+    std::shared_ptr<warrior> parse(std::string_view source);
 };
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "mmars.hpp"
+#include "parser.hpp"
+#include "cli11.hpp"
+#include "benchmark.hpp"
+
+/*
+ * Micro benchmarks for mmars. Runs every pairing of a set of warriors on the 94nop hill settings
+ * and reports the executed instructions per second for each mars variant and engine. Afterwards the benchmark is run
+ * with an increasing amount of threads to show how it scales and the warriors are parsed repeatedly to measure the
+ * parser throughput.
+ */
+
+static const uint32_t core_size         = 8000;
+static const uint32_t max_cycles        = 80000;
+static const uint32_t max_process       = 8000;
+static const uint32_t max_length        = 100;
+static const uint32_t min_separation    = 100;
+
+static const char* default_warriors[] = {
+    ";name Imp\n"
+    "        MOV.I   $0,     $1\n",
+
+    ";name Dwarf\n"
+    "        ADD.AB  #4,     bomb\n"
+    "        MOV.AB  #0,     @bomb\n"
+    "        JMP     -2,     0\n"
+    "bomb    DAT     #0,     #0\n",
+
+    ";name Stone\n"
+    "step    EQU 3044\n"
+    "        SPL     0,      <-10\n"
+    "loop    ADD     #step,  ptr\n"
+    "ptr     MOV     >-1,    }step*2\n"
+    "        DJN.F   loop,   {-3\n"
+    "        DAT     0,      0\n",
+
+    ";name Paper\n"
+    "        SPL     1,      0\n"
+    "        SPL     1,      0\n"
+    "        MOV     -1,     0\n"
+    "src     SPL     @0,     }2911\n"
+    "        MOV.I   }src,   >src\n"
+    "        MOV.I   {src,   <2667\n"
+    "        JMZ.A   src,    *src\n",
+
+    ";name Scanner\n"
+    "gap     EQU 15\n"
+    "ptr     DAT     #0,     #gap\n"
+    "top     ADD.F   inc,    ptr\n"
+    "        SNE.I   *ptr,   @ptr\n"
+    "        JMP     top,    0\n"
+    "        MOV.I   bmb,    *ptr\n"
+    "        MOV.I   bmb,    @ptr\n"
+    "        JMN     top,    ptr\n"
+    "bmb     DAT     <-1,    <-1\n"
+    "inc     DAT     #gap,   #gap\n"
+    "        END top\n",
+};
+
+template <typename M>
+void measure(const char* name, exec_engine engine, const std::vector<std::shared_ptr<warrior>>& warriors, int rounds)
+{
+    M m(core_size, max_cycles, max_process, max_length, min_separation);
+    m.engine = engine;
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (auto && a : warriors)
+    {
+        for (auto && b : warriors)
+        {
+            if (a == b) continue;
+
+            m.clear();
+            m.set_seed(1);
+            m.add_warrior(a);
+            m.add_warrior(b);
+            m.run(rounds);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("%-16s %-12s %12.0f instructions/s\n", name, engine == exec_engine::table ? "table" : "interpreter", (double)m.executed() / seconds);
+}
+
+/**
+ * \brief Benchmarks every warrior against all warriors and returns the fought rounds per second.
+ */
+double measure_benchmark(int threads, const std::vector<std::shared_ptr<warrior>>& warriors, int rounds)
+{
+    benchmark b(core_size, max_cycles, max_process, max_length, min_separation, core_size, core_size, rounds, threads);
+    for (auto && w : warriors)
+    {
+        b.add_warrior(w);
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    b.run_many(warriors);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    b.shutdown();
+
+    return (double)(warriors.size() * warriors.size() * rounds) / seconds;
+}
+
+/**
+ * \brief Parses the sources over and over for about a second and prints the parsed warriors and megabytes per second.
+ */
+void measure_parser(const std::vector<std::string>& sources)
+{
+    parser p(core_size, max_cycles, max_process, max_length, min_separation);
+
+    size_t warriors = 0;
+    size_t bytes = 0;
+    double seconds = 0.0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    while (seconds < 1.0)
+    {
+        for (auto && source : sources)
+        {
+            p.parse(std::string_view(source));
+
+            warriors++;
+            bytes += source.size();
+        }
+
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    printf("%12.0f warriors/s %8.2f MB/s\n", (double)warriors / seconds, (double)bytes / seconds / (1024.0 * 1024.0));
+}
+
+int main(int argc, char *argv[])
+{
+    CLI::App app{ "mmars - micro benchmarks" };
+
+    std::vector<std::string> warrior_paths;
+    int rounds = 20;
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+    app.add_option("-w,--w,--warrior", warrior_paths, "A list of warrior paths (defaults to a built-in set)");
+    app.add_option("-r,--r,--rounds", rounds, "Rounds per pairing");
+    app.add_option("-t,--t,--threads", threads, "Maximum amount of threads for the benchmark scaling");
+
+    try {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError &e) {
+        return app.exit(e);
+    }
+
+    std::vector<std::string> sources;
+    if (warrior_paths.empty())
+    {
+        sources.assign(std::begin(default_warriors), std::end(default_warriors));
+    }
+    else
+    {
+        for (auto && path : warrior_paths)
+        {
+            std::ifstream f(path);
+            std::stringstream s;
+            s << f.rdbuf();
+            sources.push_back(s.str());
+        }
+    }
+
+    parser p(core_size, max_cycles, max_process, max_length, min_separation);
+    std::vector<std::shared_ptr<warrior>> warriors;
+    for (auto && source : sources)
+    {
+        warriors.push_back(p.parse(std::string_view(source)));
+    }
+
+    printf("Simulation (core_size=%u max_cycles=%u max_process=%u, %zu warriors, %d rounds per pairing)\n",
+        core_size, max_cycles, max_process, warriors.size(), rounds);
+
+    for (auto engine : { exec_engine::interpreter, exec_engine::table })
+    {
+        measure<mmars>("mmars", engine, warriors, rounds);
+        measure<compact_mmars>("compact_mmars", engine, warriors, rounds);
+#ifndef MMARS_NO_HILLS
+        measure<mmars_8000>("mmars_8000", engine, warriors, rounds);
+#endif
+    }
+
+    printf("\nBenchmark scaling (every warrior against all warriors)\n");
+
+    double single = 0;
+    for (int t = 1; t <= threads; t = t * 2 > threads && t < threads ? threads : t * 2)
+    {
+        double rounds_per_second = measure_benchmark(t, warriors, rounds);
+        if (t == 1) single = rounds_per_second;
+
+        printf("%3d threads %12.0f rounds/s %6.2fx\n", t, rounds_per_second, rounds_per_second / single);
+    }
+
+    printf("\nParser\n");
+    measure_parser(sources);
+}
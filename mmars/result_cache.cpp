@@ -0,0 +1,87 @@
+#include "result_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+namespace fs = std::experimental::filesystem;
+#else
+namespace fs = std::filesystem;
+#endif
+
+static const char cache_magic[4] = { 'M', 'M', 'R', 'C' };
+static const uint32_t cache_version = 1;
+
+result_cache::result_cache(const std::string& path)
+    : _path(path)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f.is_open()) return;
+
+    uint64_t file_size = (uint64_t)f.tellg();
+    if (file_size == 0) return;
+    f.seekg(0);
+
+    header h{};
+    if (!f.read((char*)&h, sizeof(header)) || std::char_traits<char>::compare(h.magic, cache_magic, 4) != 0 ||
+        h.version != cache_version || h.record_size != sizeof(record))
+        throw std::runtime_error("not a result cache of this version: " + path);
+
+    _size = sizeof(header);
+    record r{};
+    while (f.read((char*)&r, sizeof(record)))
+    {
+        _results[r.key] = result(r.win, r.loss, r.tie);
+        _size += sizeof(record);
+    }
+    f.close();
+
+    // A record that was only partially written when the process died is cut off, so new records stay aligned
+    if (file_size > _size) fs::resize_file(path, _size);
+}
+
+bool result_cache::find(uint64_t key, result& res) const
+{
+    auto it = _results.find(key);
+    if (it == _results.end()) return false;
+
+    res = it->second;
+    return true;
+}
+
+void result_cache::insert(uint64_t key, const result& res)
+{
+    auto inserted = _results.emplace(key, res);
+    if (!inserted.second) return;
+
+    _pending.push_back(record{ key, res.win, res.loss, res.tie, 0 });
+}
+
+void result_cache::save()
+{
+    if (_pending.empty()) return;
+
+    std::ofstream f(_path, std::ios::binary | std::ios::app);
+    if (!f.is_open()) throw std::runtime_error("can't write result cache: " + _path);
+
+    if (_size == 0)
+    {
+        header h{};
+        std::char_traits<char>::copy(h.magic, cache_magic, 4);
+        h.version = cache_version;
+        h.record_size = sizeof(record);
+        f.write((const char*)&h, sizeof(header));
+    }
+
+    f.write((const char*)_pending.data(), (std::streamsize)(_pending.size() * sizeof(record)));
+    if (!f) throw std::runtime_error("can't write result cache: " + _path);
+
+    _size = (_size == 0 ? sizeof(header) : _size) + _pending.size() * sizeof(record);
+    _pending.clear();
+}
+
+size_t result_cache::size() const
+{
+    return _results.size();
+}
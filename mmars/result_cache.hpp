@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "mmars.hpp"
+
+/**
+ * \brief Stores the results of benchmark pairings in a file, so pairings that were fought before don't have to be
+ * fought again. The file is a small header followed by a flat array of fixed size records in native byte order.
+ * It can be mapped into memory as is and new records are only ever appended.
+ */
+class result_cache
+{
+private:
+    /**
+     * \brief A stored pairing. The key is built by the benchmark from the warriors, the settings and the seed.
+     */
+    struct record
+    {
+        uint64_t key;
+        uint32_t win;
+        uint32_t loss;
+        uint32_t tie;
+        uint32_t reserved;
+    };
+
+    struct header
+    {
+        char     magic[4];
+        uint32_t version;
+        uint32_t record_size;
+        uint32_t reserved;
+    };
+
+    std::string                             _path;
+    std::unordered_map<uint64_t, result>    _results;
+    std::vector<record>                     _pending;
+
+    /**
+     * \brief Size of the file up to the end of the last complete record or 0 if the file has no header yet.
+     */
+    uint64_t                                _size = 0;
+
+public:
+    /**
+     * \brief Opens a cache file and loads all stored results. A missing file is created on the first save. A partially
+     * written record at the end of the file is cut off.
+     * \param path The path to the cache file
+     */
+    explicit result_cache(const std::string& path);
+
+    /**
+     * \brief Looks up a pairing.
+     * \param key The key of the pairing
+     * \param res Receives the result if the pairing is stored
+     * \return True if the pairing is stored
+     */
+    bool find(uint64_t key, result& res) const;
+
+    /**
+     * \brief Stores the result of a pairing. It is written to the file on the next save.
+     */
+    void insert(uint64_t key, const result& res);
+
+    /**
+     * \brief Appends all results that were inserted since the last save to the file.
+     */
+    void save();
+
+    /**
+     * \brief Returns the amount of stored pairings.
+     */
+    size_t size() const;
+};
@@ -1,66 +1,118 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 /**
- * \brief task_queue represents a circular buffer that contains the active tasks of a warrior.
+ * \brief task_queues contains the active tasks of all warriors. Each warrior owns a circular buffer with a power of two
+ * capacity inside one shared allocation, so wrapping an index is a single mask.
  */
-class task_queue
+class task_queues
 {
-    int                     _size = 0;
-    int                     _front = 0;
-    int                     _count = 0;
-    std::vector<uint32_t>   _data;
+    /**
+     * \brief Read and write position of a queue. Both only ever grow and are masked on access, so count is end - front.
+     */
+    struct queue_state
+    {
+        uint32_t front = 0;
+        uint32_t end = 0;
+    };
+
+    uint32_t                    _limit = 0;
+    uint32_t                    _shift = 0;
+    uint32_t                    _mask = 0;
+    std::vector<queue_state>    _state;
+    std::vector<uint32_t>       _data;
 
 public:
-    explicit task_queue(int size)
+    /**
+     * \param queues Amount of queues (one per warrior)
+     * \param limit Maximum amount of tasks per queue
+     */
+    task_queues(uint32_t queues, uint32_t limit)
+        : _limit(limit)
+    {
+        while ((1u << _shift) < limit) _shift++;
+        _mask = (1u << _shift) - 1;
+        _state = std::vector<queue_state>(queues);
+        _data = std::vector<uint32_t>((size_t)queues << _shift, 0);
+    }
+
+    task_queues() = default;
+
+    /**
+     * \brief Returns the amount of queues.
+     */
+    uint32_t size() const
     {
-        _size = size;
-        _data = std::vector<uint32_t>(size, 0);
-        clear();
+        return (uint32_t)_state.size();
+    }
+
+    /**
+     * \brief Returns the maximum amount of tasks per queue.
+     */
+    uint32_t limit() const
+    {
+        return _limit;
     }
 
     void clear()
     {
-        _front = 0;
-        _count = 0;
+        for (auto& s : _state) s = queue_state();
     }
 
-    bool empty() const
+    bool empty(uint32_t q) const
     {
-        return _count == 0;
+        return _state[q].front == _state[q].end;
     }
 
-    bool full() const
+    bool full(uint32_t q) const
     {
-        return _count == _size;
+        return count(q) == _limit;
     }
 
-    uint32_t count() const
+    uint32_t count(uint32_t q) const
     {
-        return _count;
+        return _state[q].end - _state[q].front;
     }
 
-    bool enqueue(uint32_t val)
+    bool enqueue(uint32_t q, uint32_t val)
     {
-        if (full()) return false;
+        queue_state& s = _state[q];
+        if (s.end - s.front == _limit) return false;
 
-        int end = (_front + _count) % _size;
-        _data[end] = val;
-        _count++;
+        _data[(q << _shift) + (s.end++ & _mask)] = val;
         return true;
     }
 
-    uint32_t dequeue()
+    /**
+     * \brief Enqueues two tasks with a single capacity check. If only one slot is left the first task is enqueued.
+     * \return Amount of enqueued tasks
+     */
+    uint32_t enqueue(uint32_t q, uint32_t first, uint32_t second)
+    {
+        queue_state& s = _state[q];
+        uint32_t free = _limit - (s.end - s.front);
+        if (free == 0) return 0;
+
+        uint32_t* data = &_data[q << _shift];
+        data[s.end++ & _mask] = first;
+        if (free == 1) return 1;
+
+        data[s.end++ & _mask] = second;
+        return 2;
+    }
+
+    uint32_t dequeue(uint32_t q)
     {
-        if (empty()) return 0;
+        queue_state& s = _state[q];
+        if (s.front == s.end) return 0;
 
-        uint32_t val = _data[_front];
-        _front = _front == _size ? 0 : _front + 1;
-        _count--;
-        return val;
+        return _data[(q << _shift) + (s.front++ & _mask)];
     }
 
-    uint32_t peek(int i)
+    uint32_t peek(uint32_t q, uint32_t i) const
     {
-        return _data[_front + i % _size];
+        return _data[(q << _shift) + ((_state[q].front + i) & _mask)];
     }
-};
\ No newline at end of file
+};
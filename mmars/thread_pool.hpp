@@ -1,86 +1,232 @@
 #pragma once
 
-#include <vector>
-#include <thread>
-#include <mutex>
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 /**
- * \brief A generic thread pool to scatter tasks over a fixed number of threads.
- * \tparam T The type that tasks will return
+ * \brief A single use barrier that releases waiting threads once it was counted down to zero.
+ */
+class latch
+{
+    size_t                  _count;
+    std::mutex              _lock;
+    std::condition_variable _cv;
+
+public:
+    explicit latch(size_t count) : _count(count)
+    { }
+
+    void count_down()
+    {
+        std::unique_lock lock(_lock);
+        if (--_count == 0) _cv.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock lock(_lock);
+        _cv.wait(lock, [this]() { return _count == 0; });
+    }
+
+    bool try_wait()
+    {
+        std::unique_lock lock(_lock);
+        return _count == 0;
+    }
+};
+
+/**
+ * \brief A work-stealing thread pool. Every worker owns a deque of tasks. Workers take tasks from the back of their own
+ * deque and steal from the front of the other deques when theirs is empty. Idle workers sleep until new work arrives.
  */
-template <typename T>
 class thread_pool
 {
 private:
-    typedef std::tuple<std::shared_ptr<std::promise<T>>, std::function<T()>> work_request;
+    typedef std::function<void()> task;
+
+    /**
+     * \brief A parallel_for call. Lives on the stack of the caller, workers claim indices through the shared counter.
+     */
+    struct batch
+    {
+        void                (*invoke)(void* func, size_t i);
+        void*               func;
+        size_t              count;
+        std::atomic<size_t> next;
+        latch               done;
+        std::mutex          error_lock;
+        std::exception_ptr  error;
+
+        batch(void (*invoke)(void*, size_t), void* func, size_t count, size_t runners)
+            : invoke(invoke), func(func), count(count), next(0), done(runners)
+        { }
 
-    std::atomic<int>        _work_left;
+        void run()
+        {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                try
+                {
+                    invoke(func, i);
+                }
+                catch (...)
+                {
+                    std::unique_lock lock(error_lock);
+                    if (!error) error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    struct worker_queue
+    {
+        std::mutex          lock;
+        std::deque<task>    tasks;
+    };
+
+    std::atomic<size_t>     _pending;
+    std::atomic<size_t>     _next;
     std::atomic<bool>       _should_stop;
 
-    std::mutex              _lock;
-    std::condition_variable _cv;
+    std::mutex              _sleep_lock;
+    std::condition_variable _sleep_cv;
 
-    std::mutex                                  _lock_queue;
-    std::queue<work_request>                    _work;
-    std::vector<std::shared_ptr<std::thread>>   _threads;
+    std::vector<std::unique_ptr<worker_queue>>  _queues;
+    std::vector<std::thread>                    _threads;
 
-    void worker()
+    /**
+     * \brief Index of the worker that runs on the current thread or -1 for threads outside of the pool.
+     */
+    static int& current_worker()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    /**
+     * \brief Takes a task from the back of the own deque or steals one from the front of another deque.
+     */
+    bool take(size_t index, task& t)
     {
-        while (true)
         {
-            // Wait for work or interrupt
+            worker_queue& own = *_queues[index];
+            std::unique_lock lock(own.lock);
+            if (!own.tasks.empty())
             {
-                std::unique_lock lock(_lock);
-                _cv.wait(lock, [this]()
-                {
-                    return _should_stop || _work_left > 0;
-                });
+                t = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
             }
+        }
 
-            while(_work_left > 0)
+        for (size_t i = 1; i < _queues.size(); ++i)
+        {
+            worker_queue& victim = *_queues[(index + i) % _queues.size()];
+            std::unique_lock lock(victim.lock);
+            if (!victim.tasks.empty())
             {
-                // Get work
-                bool has_work = false;;
-                work_request request;
-                {
-                    std::unique_lock queue_lock(_lock_queue);
-                    if (!_work.empty())
-                    {
-                        has_work = true;
-                        request = _work.front();
-                        _work.pop();
-                        --_work_left;
-                    }
-                }
+                t = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
 
-                // Work found
-                if (has_work)
-                {
-                    std::get<0>(request)->set_value(std::get<1>(request)());
-                }
+        return false;
+    }
+
+    void worker(size_t index)
+    {
+        current_worker() = (int)index;
+
+        task t;
+        while (true)
+        {
+            if (take(index, t))
+            {
+                --_pending;
+                t();
+                t = nullptr;
+                continue;
             }
 
-            // Interrupt
-            if (_should_stop) return;
+            // Sleep until there is work or the pool stops. Left over work is processed before stopping.
+            std::unique_lock lock(_sleep_lock);
+            _sleep_cv.wait(lock, [this]()
+            {
+                return _should_stop || _pending > 0;
+            });
+
+            if (_should_stop && _pending == 0) return;
         }
     }
 
+    /**
+     * \brief Pushes a task without waking up a worker. Tasks submitted from a worker go to its own deque.
+     */
+    void push(task t)
+    {
+        int own = current_worker();
+        size_t index = own >= 0 ? (size_t)own : _next++ % _queues.size();
+
+        // Counted before the task is visible, otherwise a worker could take it and decrement the counter below zero
+        ++_pending;
+
+        worker_queue& queue = *_queues[index];
+        std::unique_lock lock(queue.lock);
+        queue.tasks.push_back(std::move(t));
+    }
+
+    /**
+     * \brief Wakes up sleeping workers. Taking the sleep lock makes sure that no worker misses the new work between
+     * checking for it and starting to wait.
+     */
+    void wake(bool all)
+    {
+        {
+            std::unique_lock lock(_sleep_lock);
+        }
+
+        if (all) _sleep_cv.notify_all();
+        else _sleep_cv.notify_one();
+    }
+
 public:
     explicit thread_pool(int thread_count)
     {
-        _work_left = 0;
+        _pending = 0;
+        _next = 0;
         _should_stop = false;
+
+        thread_count = std::max(thread_count, 1);
+        for (int i = 0; i < thread_count; ++i)
+        {
+            _queues.push_back(std::make_unique<worker_queue>());
+        }
+
         for (int i = 0; i < thread_count; ++i)
         {
-            _threads.push_back(std::make_shared<std::thread>([this]
+            _threads.emplace_back([this, i]
             {
-                this->worker();
-            }));
+                this->worker(i);
+            });
         }
     }
 
+    ~thread_pool()
+    {
+        if (!_should_stop) shutdown();
+    }
+
     /**
      * \brief Shuts the thread pool down. This will process left over work and stops and joins all threads.
      * After calling this function the pool is not usable anymore.
@@ -90,12 +236,12 @@ public:
         if (_should_stop) throw std::runtime_error("thread pool is already closed");
 
         _should_stop = true;
-        _cv.notify_all();
+        wake(true);
 
         for (auto && thread : _threads)
         {
-            if(thread->joinable())
-                thread->join();
+            if(thread.joinable())
+                thread.join();
         }
 
         _threads.clear();
@@ -106,20 +252,113 @@ public:
      * \param func The function that should be executed
      * \return Returns a future object with the result
      */
-    std::future<T> enqueue_work(std::function<T()> func)
+    template <typename F>
+    std::future<std::invoke_result_t<F>> enqueue_work(F func)
     {
         if (_should_stop) throw std::runtime_error("thread pool is already closed");
 
-        auto promise = std::make_shared<std::promise<T>>();
+        auto work = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(func));
+        auto future = work->get_future();
+
+        push([work]() { (*work)(); });
+        wake(false);
+
+        return future;
+    }
 
+    /**
+     * \brief Inserts multiple tasks at once. The tasks are spread over all worker deques and all workers are woken up once.
+     * \param funcs The functions that should be executed
+     * \return Returns a future object with the result of each function
+     */
+    template <typename F>
+    std::vector<std::future<std::invoke_result_t<F>>> enqueue_bulk(std::vector<F> funcs)
+    {
+        if (_should_stop) throw std::runtime_error("thread pool is already closed");
+
+        std::vector<std::future<std::invoke_result_t<F>>> futures;
+        futures.reserve(funcs.size());
+        for (auto && func : funcs)
+        {
+            auto work = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(func));
+            futures.push_back(work->get_future());
+
+            push([work]() { (*work)(); });
+        }
+        wake(true);
+
+        return futures;
+    }
+
+    /**
+     * \brief Calls func(i) for every i in [0, count) on the pool and blocks until all calls returned. The calling thread
+     * helps with the work. Nothing is allocated per index, the workers take indices from a shared counter and signal
+     * completion through a single latch. The first exception thrown by func is rethrown after all calls returned.
+     * Calls can be nested, a worker that waits for its calls runs other queued tasks in the meantime.
+     * \param count Amount of indices
+     * \param func Callable that accepts a size_t index
+     */
+    template <typename F>
+    void parallel_for(size_t count, F&& func)
+    {
+        if (_should_stop) throw std::runtime_error("thread pool is already closed");
+        if (count == 0) return;
+
+        size_t runners = std::min(count - 1, _queues.size());
+        batch b([](void* f, size_t i) { (*static_cast<std::remove_reference_t<F>*>(f))(i); }, (void*)&func, count, runners);
+
+        for (size_t i = 0; i < runners; ++i)
+        {
+            push([&b]()
+            {
+                b.run();
+                b.done.count_down();
+            });
+        }
+        wake(true);
+
+        b.run();
+
+        // A worker that calls parallel_for pushed the runners into its own deque. It runs queued tasks while it waits,
+        // otherwise its runners could be stuck behind it. Once nothing is left to take every runner has been started.
+        int own = current_worker();
+        if (own >= 0)
         {
-            std::unique_lock lock(_lock_queue);
-            _work.push(std::make_tuple(promise, func));
-            ++_work_left;
-            _cv.notify_one();
+            task t;
+            while (!b.done.try_wait() && take((size_t)own, t))
+            {
+                --_pending;
+                t();
+                t = nullptr;
+            }
         }
 
-        return promise->get_future();
+        b.done.wait();
+
+        if (b.error) std::rethrow_exception(b.error);
+    }
+
+    /**
+     * \brief Calls func(i) for every i in [0, count) on the pool and stores the returned values in results[i].
+     * \param count Amount of indices
+     * \param results Caller provided array with at least count elements
+     * \param func Callable that accepts a size_t index
+     */
+    template <typename T, typename F>
+    void map(size_t count, T* results, F&& func)
+    {
+        parallel_for(count, [results, &func](size_t i)
+        {
+            results[i] = func(i);
+        });
+    }
+
+    /**
+     * \brief Returns the amount of worker threads.
+     */
+    int size() const
+    {
+        return (int)_queues.size();
     }
 
     /**
@@ -4,7 +4,7 @@ std::string util::instruction_to_string(instruction i)
 {
     std::string out;
 
-    switch (i.op) {
+    switch (i.op()) {
     case op_code::dat:
         out += "DAT."; break;
     case op_code::nop:
@@ -40,7 +40,7 @@ std::string util::instruction_to_string(instruction i)
     default:;
     }
 
-    switch (i.mod)
+    switch (i.mod())
     {
     case modifier::i:
         out += "I\t\t"; break;
@@ -59,7 +59,7 @@ std::string util::instruction_to_string(instruction i)
     default:;
     }
 
-    switch (i.a_mode)
+    switch (i.a_mode())
     {
     case im:
         out += "#\t"; break;
@@ -82,7 +82,7 @@ std::string util::instruction_to_string(instruction i)
 
     out += std::to_string(i.a) + "\t,\t";
 
-    switch (i.b_mode)
+    switch (i.b_mode())
     {
     case im:
         out += "#\t"; break;
@@ -105,3 +105,14 @@ std::string util::instruction_to_string(instruction i)
 
     return out + std::to_string(i.b);
 }
+
+uint64_t util::hash(uint64_t hash, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        hash ^= (value >> (i * 8)) & 0xff;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -8,4 +9,14 @@
 namespace util
 {
     std::string instruction_to_string(instruction i);
+
+    /**
+     * \brief Continues a 64 bit FNV-1a hash with the bytes of value.
+     * \param hash The hash so far, start with hash_offset
+     * \param value The value to add
+     * \return The new hash
+     */
+    uint64_t hash(uint64_t hash, uint64_t value);
+
+    const uint64_t hash_offset = 14695981039346656037ull;
 }
@@ -36,4 +36,20 @@ public:
         serialize(s);
         return s.str();
     }
+
+    /**
+     * \brief Hashes the code and the start of the warrior. Name and author are ignored, so renamed copies of a
+     * warrior have the same hash.
+     */
+    uint64_t hash() const
+    {
+        uint64_t h = util::hash(util::hash_offset, ((uint64_t)start << 32) | code.size());
+        for (auto && i : code)
+        {
+            h = util::hash(h, i.code);
+            h = util::hash(h, ((uint64_t)i.a << 32) | i.b);
+        }
+
+        return h;
+    }
 };